@@ -31,4 +31,25 @@ ifeq ($(TARGET_TUNA_AUDIO_HDMI),true)
 LOCAL_CFLAGS += -DUSE_HDMI_AUDIO
 endif
 
+ifeq ($(TARGET_TUNA_AUDIO_TRACE),true)
+LOCAL_CFLAGS += -DAUDIO_HW_TRACE
+endif
+
 include $(BUILD_SHARED_LIBRARY)
+
+ifeq ($(TARGET_TUNA_AUDIO_ROUTE_DB),true)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := audio_routes.bin
+LOCAL_MODULE_CLASS := ETC
+LOCAL_MODULE_PATH := $(TARGET_OUT_ETC)
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_SYSTEM)/base_rules.mk
+
+$(LOCAL_BUILT_MODULE): PRIVATE_GEN_ROUTE_DB := $(LOCAL_PATH)/gen_route_db.py
+$(LOCAL_BUILT_MODULE): $(LOCAL_PATH)/audio_routes.txt $(LOCAL_PATH)/gen_route_db.py
+	@echo "Route database: $@"
+	@mkdir -p $(dir $@)
+	$(hide) python $(PRIVATE_GEN_ROUTE_DB) $< $@
+endif
@@ -17,7 +17,12 @@
 #define LOG_TAG "audio_hw_primary"
 /*#define LOG_NDEBUG 0*/
 
+#include "audio_trace.h"
+
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 
 #include <cutils/log.h>
@@ -114,7 +119,9 @@ static int set_route_by_array(struct mixer *mixer, struct route_setting *route,
     /* Go through the route array and set each value */
     i = 0;
     while (route[i].ctl_name) {
-        ctl = mixer_get_ctl_by_name(mixer, route[i].ctl_name);
+        ctl = route[i].ctl;
+        if (!ctl)
+            ctl = mixer_get_ctl_by_name(mixer, route[i].ctl_name);
         if (!ctl)
             return -EINVAL;
 
@@ -138,7 +145,255 @@ static int set_route_by_array(struct mixer *mixer, struct route_setting *route,
     return 0;
 }
 
-static int start_call(struct tuna_audio_device *adev)
+static void set_route(struct tuna_audio_device *adev, enum route_id id, int enable)
+{
+    set_route_by_array(adev->mixer, adev->routes[id], enable);
+}
+
+/* Looks up the mixer control of each route entry once so that applying a
+ * route does not search the mixer controls by name. Enum values are checked
+ * but still set by string: setting them by index costs an extra ioctl. */
+static int resolve_route(struct mixer *mixer, struct route_setting *route)
+{
+    struct mixer_ctl *ctl;
+    unsigned int i, j;
+    int ret = 0;
+
+    for (i = 0; route[i].ctl_name; i++) {
+        ctl = mixer_get_ctl_by_name(mixer, route[i].ctl_name);
+        if (!ctl) {
+            ALOGE("resolve_route(): unknown control %s", route[i].ctl_name);
+            ret = -EINVAL;
+            continue;
+        }
+
+        if (route[i].strval) {
+            for (j = 0; j < mixer_ctl_get_num_enums(ctl); j++) {
+                if (!strcmp(mixer_ctl_get_enum_string(ctl, j), route[i].strval))
+                    break;
+            }
+            if (j == mixer_ctl_get_num_enums(ctl)) {
+                ALOGE("resolve_route(): unknown value %s for control %s",
+                      route[i].strval, route[i].ctl_name);
+                ret = -EINVAL;
+                continue;
+            }
+        }
+        route[i].ctl = ctl;
+    }
+
+    return ret;
+}
+
+static const char *route_db_string(const char *strings, uint32_t strings_size,
+                                   uint32_t offset)
+{
+    if (offset >= strings_size ||
+            memchr(strings + offset, '\0', strings_size - offset) == NULL)
+        return NULL;
+
+    return strings + offset;
+}
+
+static void unload_route_db(struct tuna_audio_device *adev)
+{
+    if (adev->route_db.map)
+        munmap(adev->route_db.map, adev->route_db.map_size);
+    free(adev->route_db.settings);
+    memset(&adev->route_db, 0, sizeof(adev->route_db));
+}
+
+/* Replaces the built-in routes by the ones found in ROUTE_DB_PATH, if any.
+ * Control and enum value names point into the mapped file, which stays
+ * mapped until adev_close(). A route which does not resolve against the
+ * mixer keeps its built-in definition. */
+static void load_route_db(struct tuna_audio_device *adev)
+{
+    struct route_db *db = &adev->route_db;
+    const struct route_db_header *header;
+    const struct route_db_route *routes;
+    const struct route_db_setting *settings;
+    const char *strings;
+    struct route_setting *route;
+    size_t capacity;
+    struct stat st;
+    uint64_t expected_size;
+    unsigned int i, j, id;
+    unsigned int loaded = 0;
+    int fd;
+
+    fd = open(ROUTE_DB_PATH, O_RDONLY);
+    if (fd < 0) {
+        ALOGV("no route database, using built-in routes");
+        return;
+    }
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*header)) {
+        ALOGE("invalid route database %s", ROUTE_DB_PATH);
+        close(fd);
+        return;
+    }
+
+    db->map_size = st.st_size;
+    db->map = mmap(NULL, db->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (db->map == MAP_FAILED) {
+        ALOGE("cannot map route database %s: %s", ROUTE_DB_PATH, strerror(errno));
+        db->map = NULL;
+        goto err;
+    }
+
+    header = (const struct route_db_header *)db->map;
+    expected_size = sizeof(*header) +
+            (uint64_t)header->num_routes * sizeof(*routes) +
+            (uint64_t)header->num_settings * sizeof(*settings) +
+            header->strings_size;
+    if (header->magic != ROUTE_DB_MAGIC || header->version != ROUTE_DB_VERSION ||
+            expected_size != db->map_size) {
+        ALOGE("route database %s: bad magic, version %u or size %u",
+              ROUTE_DB_PATH, header->version, (unsigned int)db->map_size);
+        goto err;
+    }
+
+    routes = (const struct route_db_route *)(header + 1);
+    settings = (const struct route_db_setting *)(routes + header->num_routes);
+    strings = (const char *)(settings + header->num_settings);
+
+    /* every route is terminated by an entry with a NULL ctl_name */
+    capacity = (size_t)header->num_settings + header->num_routes;
+    db->settings = (struct route_setting *)calloc(capacity, sizeof(struct route_setting));
+    if (!db->settings)
+        goto err;
+
+    route = db->settings;
+    for (i = 0; i < header->num_routes; i++) {
+        const char *name = route_db_string(strings, header->strings_size, routes[i].name);
+
+        for (id = 0; name && id < ROUTE_TOTAL; id++) {
+            if (!strcmp(name, route_table[id].name))
+                break;
+        }
+        if (!name || id == ROUTE_TOTAL) {
+            ALOGW("route database: skipping unknown route %s", name ? name : "?");
+            continue;
+        }
+        if (routes[i].first_setting > header->num_settings ||
+                routes[i].num_settings > header->num_settings - routes[i].first_setting) {
+            ALOGW("route database: skipping route %s with bad settings", name);
+            continue;
+        }
+        /* the ranges of a malformed database may overlap */
+        if (routes[i].num_settings >= capacity - (size_t)(route - db->settings)) {
+            ALOGW("route database: skipping route %s, settings overflow", name);
+            continue;
+        }
+
+        for (j = 0; j < routes[i].num_settings; j++) {
+            const struct route_db_setting *setting = &settings[routes[i].first_setting + j];
+
+            route[j].ctl_name = (char *)route_db_string(strings, header->strings_size,
+                                                        setting->ctl_name);
+            route[j].strval = NULL;
+            if (setting->strval != ROUTE_DB_NO_STRING)
+                route[j].strval = (char *)route_db_string(strings, header->strings_size,
+                                                          setting->strval);
+            route[j].intval = setting->intval;
+            if (!route[j].ctl_name ||
+                    (setting->strval != ROUTE_DB_NO_STRING && !route[j].strval))
+                break;
+        }
+        route[j].ctl_name = NULL;
+
+        if (j != routes[i].num_settings || resolve_route(adev->mixer, route) != 0) {
+            ALOGW("route database: keeping built-in route %s", name);
+            continue;
+        }
+
+        adev->routes[id] = route;
+        route += routes[i].num_settings + 1;
+        loaded++;
+    }
+
+    ALOGI("loaded %u routes from %s", loaded, ROUTE_DB_PATH);
+    return;
+
+err:
+    unload_route_db(adev);
+}
+
+/* must be called before any route is applied */
+static void init_routes(struct tuna_audio_device *adev)
+{
+    unsigned int id;
+
+    for (id = 0; id < ROUTE_TOTAL; id++) {
+        adev->routes[id] = route_table[id].settings;
+        resolve_route(adev->mixer, adev->routes[id]);
+    }
+
+    load_route_db(adev);
+}
+
+static void set_gain_all_channels(struct mixer_ctl *ctl, int value)
+{
+    unsigned int j;
+
+    for (j = 0; j < mixer_ctl_get_num_values(ctl); j++)
+        mixer_ctl_set_value(ctl, j, value);
+}
+
+/* Queue a gain change on an ABE gain control. The ramp starts from the
+ * current value of the first channel; nothing is queued if the gain is
+ * already at target. If the queue is full the gain is set immediately. */
+static void add_gain_ramp(struct gain_ramp *ramps, unsigned int *num_ramps,
+                          struct mixer_ctl *ctl, int target)
+{
+    int start = mixer_ctl_get_value(ctl, 0);
+
+    if (start == target)
+        return;
+
+    if (*num_ramps >= MAX_GAIN_RAMPS) {
+        set_gain_all_channels(ctl, target);
+        return;
+    }
+
+    ramps[*num_ramps].ctl = ctl;
+    ramps[*num_ramps].start = start;
+    ramps[*num_ramps].target = target;
+    (*num_ramps)++;
+}
+
+/* Move all queued gains to their target together in GAIN_RAMP_STEPS linear
+ * steps, GAIN_RAMP_STEP_US apart. ABE gains are in 1 dB steps so a few
+ * milliseconds are enough to avoid the click of a hard gain jump. */
+static void run_gain_ramps(struct gain_ramp *ramps, unsigned int num_ramps)
+{
+    unsigned int i;
+    int step;
+
+    if (num_ramps == 0)
+        return;
+
+    for (step = 1; step <= GAIN_RAMP_STEPS; step++) {
+        for (i = 0; i < num_ramps; i++)
+            set_gain_all_channels(ramps[i].ctl, ramps[i].start +
+                    (ramps[i].target - ramps[i].start) * step / GAIN_RAMP_STEPS);
+        if (step < GAIN_RAMP_STEPS)
+            usleep(GAIN_RAMP_STEP_US);
+    }
+}
+
+static void ramp_gain(struct mixer_ctl *ctl, int target)
+{
+    struct gain_ramp ramp;
+    unsigned int num_ramps = 0;
+
+    add_gain_ramp(&ramp, &num_ramps, ctl, target);
+    run_gain_ramps(&ramp, num_ramps);
+}
+
+static int open_call_pcms(struct tuna_audio_device *adev)
 {
     ALOGE("Opening modem PCMs");
 
@@ -161,9 +416,6 @@ static int start_call(struct tuna_audio_device *adev)
         }
     }
 
-    pcm_start(adev->pcm_modem_dl);
-    pcm_start(adev->pcm_modem_ul);
-
     return 0;
 
 err_open_ul:
@@ -176,6 +428,19 @@ err_open_dl:
     return -ENOMEM;
 }
 
+static int start_call(struct tuna_audio_device *adev)
+{
+    int ret = open_call_pcms(adev);
+
+    if (ret)
+        return ret;
+
+    pcm_start(adev->pcm_modem_dl);
+    pcm_start(adev->pcm_modem_ul);
+
+    return 0;
+}
+
 static void end_call(struct tuna_audio_device *adev)
 {
     ALOGE("Closing modem PCMs");
@@ -188,6 +453,62 @@ static void end_call(struct tuna_audio_device *adev)
     adev->pcm_modem_ul = NULL;
 }
 
+static long elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 +
+           (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/* Opens the modem PCMs and connects to RILD. Runs on its own thread while
+ * select_mode() programs the mixer, so it must not take any stream lock
+ * nor touch the mixer. The hw device lock is held by select_mode()
+ * for the whole lifetime of the thread, and the thread is joined before
+ * any other RIL request. The PCMs are only started once the mixer is
+ * routed. */
+static void *call_setup_thread_func(void *context)
+{
+    struct tuna_audio_device *adev = (struct tuna_audio_device *)context;
+
+    open_call_pcms(adev);
+    ALOGI("call setup: modem PCMs opened after %ld ms",
+          elapsed_ms(&adev->call_setup_start));
+
+    ril_connect(adev->ril_handle);
+    ALOGI("call setup: RIL connected after %ld ms",
+          elapsed_ms(&adev->call_setup_start));
+
+    return NULL;
+}
+
+static void start_call_setup(struct tuna_audio_device *adev)
+{
+    clock_gettime(CLOCK_MONOTONIC, &adev->call_setup_start);
+
+    if (pthread_create(&adev->call_setup_thread, NULL,
+                       call_setup_thread_func, adev) == 0) {
+        adev->call_setup_pending = true;
+        return;
+    }
+
+    ALOGW("cannot create call setup thread, setting up call synchronously");
+    call_setup_thread_func(adev);
+}
+
+/* Must be called before any RIL request and before the voice path is
+ * unmuted */
+static void finish_call_setup(struct tuna_audio_device *adev)
+{
+    if (!adev->call_setup_pending)
+        return;
+
+    pthread_join(adev->call_setup_thread, NULL);
+    adev->call_setup_pending = false;
+    ALOGI("call setup: joined after %ld ms", elapsed_ms(&adev->call_setup_start));
+}
+
 static void set_eq_filter(struct tuna_audio_device *adev)
 {
     /* DL1_EQ can't be used for bt */
@@ -308,6 +629,8 @@ static void set_input_volumes(struct tuna_audio_device *adev, int main_mic_on,
 static void set_output_volumes(struct tuna_audio_device *adev, bool tty_volume)
 {
     unsigned int channel;
+    struct gain_ramp ramps[MAX_GAIN_RAMPS];
+    unsigned int num_ramps = 0;
     int speaker_volume;
     int headset_volume;
     int earpiece_volume;
@@ -380,37 +703,53 @@ static void set_output_volumes(struct tuna_audio_device *adev, bool tty_volume)
         speaker_volume_overrange = MIXER_ABE_GAIN_0DB;
 
     if (adev->mode == AUDIO_MODE_IN_CALL) {
-        mixer_ctl_set_value(adev->mixer_ctls.tones_dl1_volume, 0,
-                            MIXER_ABE_GAIN_0DB + dl1_volume_correction);
-        mixer_ctl_set_value(adev->mixer_ctls.vx_dl2_volume, 0,
-                                speaker_volume_overrange);
-        mixer_ctl_set_value(adev->mixer_ctls.tones_dl2_volume, 0,
-                                speaker_volume_overrange + dl2_volume_correction);
+        add_gain_ramp(ramps, &num_ramps, adev->mixer_ctls.tones_dl1_volume,
+                      MIXER_ABE_GAIN_0DB + dl1_volume_correction);
+        add_gain_ramp(ramps, &num_ramps, adev->mixer_ctls.vx_dl2_volume,
+                      speaker_volume_overrange);
+        add_gain_ramp(ramps, &num_ramps, adev->mixer_ctls.tones_dl2_volume,
+                      speaker_volume_overrange + dl2_volume_correction);
     } else if ((adev->mode == AUDIO_MODE_IN_COMMUNICATION) ||
 		    (adev->mode == AUDIO_MODE_RINGTONE)) {
-        mixer_ctl_set_value(adev->mixer_ctls.tones_dl1_volume, 0,
-                            MIXER_ABE_GAIN_0DB);
-        mixer_ctl_set_value(adev->mixer_ctls.tones_dl2_volume, 0,
-                                speaker_volume_overrange);
+        add_gain_ramp(ramps, &num_ramps, adev->mixer_ctls.tones_dl1_volume,
+                      MIXER_ABE_GAIN_0DB);
+        add_gain_ramp(ramps, &num_ramps, adev->mixer_ctls.tones_dl2_volume,
+                      speaker_volume_overrange);
     } else {
-        mixer_ctl_set_value(adev->mixer_ctls.tones_dl1_volume, 0,
-                            MIXER_ABE_GAIN_0DB + dl1_volume_correction);
-        mixer_ctl_set_value(adev->mixer_ctls.tones_dl2_volume, 0,
-                                speaker_volume_overrange + dl2_volume_correction);
+        add_gain_ramp(ramps, &num_ramps, adev->mixer_ctls.tones_dl1_volume,
+                      MIXER_ABE_GAIN_0DB + dl1_volume_correction);
+        add_gain_ramp(ramps, &num_ramps, adev->mixer_ctls.tones_dl2_volume,
+                      speaker_volume_overrange + dl2_volume_correction);
     }
 
-    mixer_ctl_set_value(adev->mixer_ctls.mm_dl1_volume, 0,
-                        MIXER_ABE_GAIN_0DB + dl1_volume_correction);
-    mixer_ctl_set_value(adev->mixer_ctls.mm_dl2_volume, 0,
-                            speaker_volume_overrange + dl2_volume_correction);
+    add_gain_ramp(ramps, &num_ramps, adev->mixer_ctls.mm_dl1_volume,
+                  MIXER_ABE_GAIN_0DB + dl1_volume_correction);
+    add_gain_ramp(ramps, &num_ramps, adev->mixer_ctls.mm_dl2_volume,
+                  speaker_volume_overrange + dl2_volume_correction);
+
+    /* the digital gains are ramped together, the codec gains below are not */
+    run_gain_ramps(ramps, num_ramps);
 
     mixer_ctl_set_value(adev->mixer_ctls.earpiece_volume, 0,
         DB_TO_EARPIECE_VOLUME(earpiece_volume));
 }
 
-static void force_all_standby(struct tuna_audio_device *adev)
+/* must be called with hw device mutex locked */
+static void force_input_standby(struct tuna_audio_device *adev)
 {
     struct tuna_stream_in *in;
+
+    /* do_input_standby() removes the stream from the capture clients */
+    while (adev->capture.num_clients != 0) {
+        in = adev->capture.clients[0];
+        pthread_mutex_lock(&in->lock);
+        do_input_standby(in);
+        pthread_mutex_unlock(&in->lock);
+    }
+}
+
+static void force_all_standby(struct tuna_audio_device *adev)
+{
     struct tuna_stream_out *out;
 
     /* only needed for low latency output streams as other streams are not used
@@ -423,16 +762,12 @@ static void force_all_standby(struct tuna_audio_device *adev)
         pthread_mutex_unlock(&out->lock);
     }
 
-    if (adev->active_input) {
-        in = adev->active_input;
-        pthread_mutex_lock(&in->lock);
-        do_input_standby(in);
-        pthread_mutex_unlock(&in->lock);
-    }
+    force_input_standby(adev);
 }
 
 static void select_mode(struct tuna_audio_device *adev)
 {
+    AUDIO_TRACE_BEGIN("select_mode");
     if (adev->mode == AUDIO_MODE_IN_CALL) {
         ALOGE("Entering IN_CALL state, in_call=%d", adev->in_call);
         if (!adev->in_call) {
@@ -452,9 +787,16 @@ static void select_mode(struct tuna_audio_device *adev)
                 adev->in_device = AUDIO_DEVICE_IN_BUILTIN_MIC & ~AUDIO_DEVICE_BIT_IN;
             } else
                 adev->out_device &= ~AUDIO_DEVICE_OUT_SPEAKER;
+            /* open the modem PCMs and connect to RILD while the
+            mixer is being programmed */
+            start_call_setup(adev);
             select_output_device(adev);
+            ALOGI("call setup: output device selected after %ld ms",
+                  elapsed_ms(&adev->call_setup_start));
+            finish_call_setup(adev);
             start_call(adev);
             ril_set_call_volume(adev->ril_handle, SOUND_TYPE_VOICE, adev->voice_volume);
+            ALOGI("call setup: done after %ld ms", elapsed_ms(&adev->call_setup_start));
             adev->in_call = 1;
         }
     } else {
@@ -468,6 +810,7 @@ static void select_mode(struct tuna_audio_device *adev)
             select_input_device(adev);
         }
     }
+    AUDIO_TRACE_END();
 }
 
 static void select_output_device(struct tuna_audio_device *adev)
@@ -480,16 +823,14 @@ static void select_output_device(struct tuna_audio_device *adev)
     int dl1_on;
     int sidetone_capture_on = 0;
     bool tty_volume = false;
-    unsigned int channel;
 
-    /* Mute VX_UL to avoid pop noises in the tx path
+    AUDIO_TRACE_BEGIN("select_output_device");
+
+    /* Fade out VX_UL to avoid pop noises in the tx path
      * during call before switch changes.
      */
-    if (adev->mode == AUDIO_MODE_IN_CALL) {
-        for (channel = 0; channel < 2; channel++)
-            mixer_ctl_set_value(adev->mixer_ctls.voice_ul_volume,
-                                channel, 0);
-    }
+    if (adev->mode == AUDIO_MODE_IN_CALL)
+        ramp_gain(adev->mixer_ctls.voice_ul_volume, 0);
 
     headset_on = adev->out_device & AUDIO_DEVICE_OUT_WIRED_HEADSET;
     headphone_on = adev->out_device & AUDIO_DEVICE_OUT_WIRED_HEADPHONE;
@@ -548,8 +889,8 @@ static void select_output_device(struct tuna_audio_device *adev)
     mixer_ctl_set_value(adev->mixer_ctls.earpiece_enable, 0, earpiece_on);
 
     /* select output stage */
-    set_route_by_array(adev->mixer, hs_output, headset_on | headphone_on);
-    set_route_by_array(adev->mixer, hf_output, speaker_on);
+    set_route(adev, ROUTE_HS_OUTPUT, headset_on | headphone_on);
+    set_route(adev, ROUTE_HF_OUTPUT, speaker_on);
 
     set_eq_filter(adev);
     set_output_volumes(adev, tty_volume);
@@ -559,7 +900,7 @@ static void select_output_device(struct tuna_audio_device *adev)
        todo: use sub mic for handsfree case */
     if (adev->mode == AUDIO_MODE_IN_CALL) {
         if (bt_on)
-            set_route_by_array(adev->mixer, vx_ul_bt, bt_on);
+            set_route(adev, ROUTE_VX_UL_BT, bt_on);
         else {
             /* force tx path according to TTY mode when in call */
             switch(adev->tty_mode) {
@@ -584,11 +925,11 @@ static void select_output_device(struct tuna_audio_device *adev)
             }
 
             if (headset_on || headphone_on || earpiece_on)
-                set_route_by_array(adev->mixer, vx_ul_amic_left, 1);
+                set_route(adev, ROUTE_VX_UL_AMIC_LEFT, 1);
             else if (speaker_on)
-                set_route_by_array(adev->mixer, vx_ul_amic_right, 1);
+                set_route(adev, ROUTE_VX_UL_AMIC_RIGHT, 1);
             else
-                set_route_by_array(adev->mixer, vx_ul_amic_left, 0);
+                set_route(adev, ROUTE_VX_UL_AMIC_LEFT, 0);
 
             mixer_ctl_set_enum_by_string(adev->mixer_ctls.left_capture,
                                         (earpiece_on || headphone_on) ? MIXER_MAIN_MIC :
@@ -603,16 +944,18 @@ static void select_output_device(struct tuna_audio_device *adev)
             sidetone_capture_on = earpiece_on; // TODO: previously, '&& adev->device_is_toro'
         }
 
+        /* RILD must be connected by the setup thread before the call
+        audio path is requested */
+        finish_call_setup(adev);
+
         set_incall_device(adev);
 
-        /* Unmute VX_UL after the switch */
-        for (channel = 0; channel < 2; channel++) {
-            mixer_ctl_set_value(adev->mixer_ctls.voice_ul_volume,
-                                channel, MIXER_ABE_GAIN_0DB);
-        }
+        /* Fade VX_UL back in after the switch */
+        ramp_gain(adev->mixer_ctls.voice_ul_volume, MIXER_ABE_GAIN_0DB);
     }
 
     mixer_ctl_set_value(adev->mixer_ctls.sidetone_capture, 0, sidetone_capture_on);
+    AUDIO_TRACE_END();
 }
 
 static void select_input_device(struct tuna_audio_device *adev)
@@ -622,6 +965,7 @@ static void select_input_device(struct tuna_audio_device *adev)
     int sub_mic_on = 0;
     int bt_on = adev->in_device & AUDIO_DEVICE_IN_ALL_SCO;
 
+    AUDIO_TRACE_BEGIN("select_input_device");
     if (!bt_on) {
         if ((adev->mode != AUDIO_MODE_IN_CALL) && (adev->active_input != 0)) {
             /* sub mic is used for camcorder or VoIP on speaker phone */
@@ -639,7 +983,7 @@ static void select_input_device(struct tuna_audio_device *adev)
     * both use cases are mutually exclusive.
     */
     if (bt_on)
-        set_route_by_array(adev->mixer, mm_ul2_bt, 1);
+        set_route(adev, ROUTE_MM_UL2_BT, 1);
     else {
         /* Select front end */
 
@@ -649,24 +993,24 @@ static void select_input_device(struct tuna_audio_device *adev)
             ALOGV("select input device(): multi-mic configuration main mic %s sub mic %s",
                   main_mic_on ? "ON" : "OFF", sub_mic_on ? "ON" : "OFF");
             if (main_mic_on) {
-                set_route_by_array(adev->mixer, mm_ul2_amic_dual_main_sub, 1);
+                set_route(adev, ROUTE_MM_UL2_AMIC_DUAL_MAIN_SUB, 1);
                 sub_mic_on = 1;
             }
             else if (sub_mic_on) {
-                set_route_by_array(adev->mixer, mm_ul2_amic_dual_sub_main, 1);
+                set_route(adev, ROUTE_MM_UL2_AMIC_DUAL_SUB_MAIN, 1);
                 main_mic_on = 1;
             }
             else {
-                set_route_by_array(adev->mixer, mm_ul2_amic_dual_main_sub, 0);
+                set_route(adev, ROUTE_MM_UL2_AMIC_DUAL_MAIN_SUB, 0);
             }
         } else {
             ALOGV("select input device(): single mic configuration");
             if (main_mic_on || headset_on)
-                set_route_by_array(adev->mixer, mm_ul2_amic_left, 1);
+                set_route(adev, ROUTE_MM_UL2_AMIC_LEFT, 1);
             else if (sub_mic_on)
-                set_route_by_array(adev->mixer, mm_ul2_amic_right, 1);
+                set_route(adev, ROUTE_MM_UL2_AMIC_RIGHT, 1);
             else
-                set_route_by_array(adev->mixer, mm_ul2_amic_left, 0);
+                set_route(adev, ROUTE_MM_UL2_AMIC_LEFT, 0);
         }
 
 
@@ -679,6 +1023,7 @@ static void select_input_device(struct tuna_audio_device *adev)
     }
 
     set_input_volumes(adev, main_mic_on, headset_on, sub_mic_on);
+    AUDIO_TRACE_END();
 }
 
 /* must be called with hw device and output stream mutexes locked */
@@ -1031,6 +1376,7 @@ static int do_output_standby(struct tuna_stream_out *out)
     bool all_outputs_in_standby = true;
 
     if (!out->standby) {
+        AUDIO_TRACE_BEGIN("do_output_standby");
         out->standby = 1;
 
         for (i = 0; i < PCM_TOTAL; i++) {
@@ -1049,8 +1395,8 @@ static int do_output_standby(struct tuna_stream_out *out)
         /* if in call, don't turn off the output stage. This will
         be done when the call is ended */
         if (all_outputs_in_standby && adev->mode != AUDIO_MODE_IN_CALL) {
-            set_route_by_array(adev->mixer, hs_output, 0);
-            set_route_by_array(adev->mixer, hf_output, 0);
+            set_route(adev, ROUTE_HS_OUTPUT, 0);
+            set_route(adev, ROUTE_HF_OUTPUT, 0);
         }
 
 #ifdef USE_HDMI_AUDIO
@@ -1072,6 +1418,7 @@ static int do_output_standby(struct tuna_stream_out *out)
             out->echo_reference->write(out->echo_reference, NULL);
             out->echo_reference = NULL;
         }
+        AUDIO_TRACE_END();
     }
     return 0;
 }
@@ -1098,12 +1445,11 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
 {
     struct tuna_stream_out *out = (struct tuna_stream_out *)stream;
     struct tuna_audio_device *adev = out->dev;
-    struct tuna_stream_in *in;
     struct str_parms *parms;
     char *str;
     char value[32];
     int ret, val = 0;
-    bool force_input_standby = false;
+    bool input_standby = false;
 
     parms = str_parms_create_str(kvpairs);
 
@@ -1120,7 +1466,7 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
                 /* a change in output device may change the microphone selection */
                 if (adev->active_input &&
                         adev->active_input->source == AUDIO_SOURCE_VOICE_COMMUNICATION) {
-                    force_input_standby = true;
+                    input_standby = true;
                 }
                 /* force standby if moving to/from HDMI/SPDIF or if the output
                  * device changes when in HDMI/SPDIF mode */
@@ -1158,12 +1504,8 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
 #endif
         }
         pthread_mutex_unlock(&out->lock);
-        if (force_input_standby) {
-            in = adev->active_input;
-            pthread_mutex_lock(&in->lock);
-            do_input_standby(in);
-            pthread_mutex_unlock(&in->lock);
-        }
+        if (input_standby)
+            force_input_standby(adev);
         pthread_mutex_unlock(&adev->lock);
     }
 
@@ -1258,10 +1600,11 @@ static ssize_t out_write_low_latency(struct audio_stream_out *stream, const void
     struct tuna_stream_out *out = (struct tuna_stream_out *)stream;
     struct tuna_audio_device *adev = out->dev;
     size_t frames = bytes / audio_stream_out_frame_size(stream);
-    bool force_input_standby = false;
-    struct tuna_stream_in *in;
+    bool input_standby = false;
     int i;
 
+    AUDIO_TRACE_BEGIN("out_write_low_latency");
+
     /* acquiring hw device mutex systematically is useful if a low priority thread is waiting
      * on the output stream mutex - e.g. executing select_mode() while holding the hw device
      * mutex
@@ -1269,7 +1612,9 @@ static ssize_t out_write_low_latency(struct audio_stream_out *stream, const void
     pthread_mutex_lock(&adev->lock);
     pthread_mutex_lock(&out->lock);
     if (out->standby) {
+        AUDIO_TRACE_BEGIN("start_output_stream_low_latency");
         ret = start_output_stream_low_latency(out);
+        AUDIO_TRACE_END();
         if (ret != 0) {
             pthread_mutex_unlock(&adev->lock);
             goto exit;
@@ -1278,7 +1623,7 @@ static ssize_t out_write_low_latency(struct audio_stream_out *stream, const void
         /* a change in output device may change the microphone selection */
         if (adev->active_input &&
                 adev->active_input->source == AUDIO_SOURCE_VOICE_COMMUNICATION)
-            force_input_standby = true;
+            input_standby = true;
     }
     pthread_mutex_unlock(&adev->lock);
 
@@ -1294,7 +1639,9 @@ static ssize_t out_write_low_latency(struct audio_stream_out *stream, const void
     /* Write to all active PCMs */
     for (i = 0; i < PCM_TOTAL; i++) {
         if (out->pcm[i]) {
+            AUDIO_TRACE_BEGIN("pcm_write");
             ret = PCM_WRITE(out->pcm[i], (void *)buffer, bytes);
+            AUDIO_TRACE_END();
             if (ret)
                 break;
         }
@@ -1308,17 +1655,13 @@ exit:
                out_get_sample_rate(&stream->common));
     }
 
-    if (force_input_standby) {
+    if (input_standby) {
         pthread_mutex_lock(&adev->lock);
-        if (adev->active_input) {
-            in = adev->active_input;
-            pthread_mutex_lock(&in->lock);
-            do_input_standby(in);
-            pthread_mutex_unlock(&in->lock);
-        }
+        force_input_standby(adev);
         pthread_mutex_unlock(&adev->lock);
     }
 
+    AUDIO_TRACE_END();
     return bytes;
 }
 
@@ -1332,6 +1675,8 @@ static ssize_t out_write_deep_buffer(struct audio_stream_out *stream, const void
     bool use_long_periods;
     int kernel_frames;
 
+    AUDIO_TRACE_BEGIN("out_write_deep_buffer");
+
     /* acquiring hw device mutex systematically is useful if a low priority thread is waiting
      * on the output stream mutex - e.g. executing select_mode() while holding the hw device
      * mutex
@@ -1339,7 +1684,9 @@ static ssize_t out_write_deep_buffer(struct audio_stream_out *stream, const void
     pthread_mutex_lock(&adev->lock);
     pthread_mutex_lock(&out->lock);
     if (out->standby) {
+        AUDIO_TRACE_BEGIN("start_output_stream_deep_buffer");
         ret = start_output_stream_deep_buffer(out);
+        AUDIO_TRACE_END();
         if (ret != 0) {
             pthread_mutex_unlock(&adev->lock);
             goto exit;
@@ -1368,6 +1715,8 @@ static ssize_t out_write_deep_buffer(struct audio_stream_out *stream, const void
                                (unsigned int *)&kernel_frames, &time_stamp) < 0)
             break;
         kernel_frames = pcm_get_buffer_size(out->pcm[PCM_NORMAL]) - kernel_frames;
+        AUDIO_TRACE_INT("deep_buffer_kernel_frames", kernel_frames);
+        AUDIO_TRACE_INT("deep_buffer_write_threshold", out->write_threshold);
 
         if (kernel_frames > out->write_threshold) {
             unsigned long time = (unsigned long)
@@ -1378,7 +1727,9 @@ static ssize_t out_write_deep_buffer(struct audio_stream_out *stream, const void
         }
     } while (kernel_frames > out->write_threshold);
 
+    AUDIO_TRACE_BEGIN("pcm_mmap_write");
     ret = pcm_mmap_write(out->pcm[PCM_NORMAL], buffer, bytes);
+    AUDIO_TRACE_END();
 
 exit:
     pthread_mutex_unlock(&out->lock);
@@ -1388,6 +1739,7 @@ exit:
                out_get_sample_rate(&stream->common));
     }
 
+    AUDIO_TRACE_END();
     return bytes;
 }
 
@@ -1401,6 +1753,8 @@ static ssize_t out_write_hdmi(struct audio_stream_out *stream, const void* buffe
     size_t frame_size = audio_stream_out_frame_size(&out->stream);
     size_t in_frames = bytes / frame_size;
 
+    AUDIO_TRACE_BEGIN("out_write_hdmi");
+
     /* acquiring hw device mutex systematically is useful if a low priority thread is waiting
      * on the output stream mutex - e.g. executing select_mode() while holding the hw device
      * mutex
@@ -1408,7 +1762,9 @@ static ssize_t out_write_hdmi(struct audio_stream_out *stream, const void* buffe
     pthread_mutex_lock(&adev->lock);
     pthread_mutex_lock(&out->lock);
     if (out->standby) {
+        AUDIO_TRACE_BEGIN("start_output_stream_hdmi");
         ret = start_output_stream_hdmi(out);
+        AUDIO_TRACE_END();
         if (ret != 0) {
             pthread_mutex_unlock(&adev->lock);
             goto exit;
@@ -1420,9 +1776,11 @@ static ssize_t out_write_hdmi(struct audio_stream_out *stream, const void* buffe
     if (out->muted)
         memset((void *)buffer, 0, bytes);
 
+    AUDIO_TRACE_BEGIN("pcm_write");
     ret = pcm_write(out->pcm[PCM_HDMI],
                    buffer,
                    pcm_frames_to_bytes(out->pcm[PCM_HDMI], in_frames));
+    AUDIO_TRACE_END();
 
 exit:
     pthread_mutex_unlock(&out->lock);
@@ -1437,6 +1795,7 @@ exit:
             (--out->restart_periods_cnt == 0))
         out_standby(&stream->common);
 
+    AUDIO_TRACE_END();
     return bytes;
 }
 #endif
@@ -1459,18 +1818,144 @@ static int out_remove_audio_effect(const struct audio_stream *stream __unused, e
 
 /** audio_stream_in implementation **/
 
+static size_t in_frames_to_bytes(struct tuna_stream_in *in, size_t frames)
+{
+    return frames * in->config.channels * sizeof(int16_t);
+}
+
+/* an input stream can join the running capture if it uses the same device and
+ * source, as the source selects the mic route and the preprocessing, and does
+ * not need more channels than the pcm was opened with */
+static bool can_share_capture(struct tuna_stream_in *in)
+{
+    struct tuna_audio_device *adev = in->dev;
+    struct tuna_capture *capture = &adev->capture;
+
+    return (capture->num_clients != 0) &&
+           (capture->num_clients < MAX_CAPTURE_CLIENTS) &&
+           (adev->active_input->device == in->device) &&
+           (adev->active_input->source == in->source) &&
+           (in->config.channels <= capture->config.channels);
+}
+
 /* must be called with hw device and input stream mutexes locked */
-static int start_input_stream(struct tuna_stream_in *in)
+static int capture_attach(struct tuna_stream_in *in)
 {
+    struct tuna_capture *capture = &in->dev->capture;
     int ret = 0;
-    struct tuna_audio_device *adev = in->dev;
 
-    adev->active_input = in;
+    pthread_mutex_lock(&capture->lock);
+    if (capture->num_clients == 0) {
+        /* this assumes routing is done previously */
+        memcpy(&capture->config, &in->config, sizeof(in->config));
+        capture->pcm = pcm_open(0, PORT_MM2_UL, PCM_IN, &capture->config);
+        if (!pcm_is_ready(capture->pcm)) {
+            ALOGE("cannot open pcm_in driver: %s", pcm_get_error(capture->pcm));
+            pcm_close(capture->pcm);
+            capture->pcm = NULL;
+            ret = -ENOMEM;
+            goto exit;
+        }
+        capture->ring_frames = capture->config.period_size * CAPTURE_RING_PERIOD_COUNT;
+        capture->ring = (int16_t *)malloc(pcm_frames_to_bytes(capture->pcm,
+                                                              capture->ring_frames));
+        ALOG_ASSERT((capture->ring != NULL), "capture_attach() failed to allocate ring");
+        capture->frames_written = 0;
+    }
 
-    if (adev->mode != AUDIO_MODE_IN_CALL) {
-        adev->in_device = in->device;
-        select_input_device(adev);
+    /* new clients start with the next period read from the driver */
+    in->capture_pos = capture->frames_written;
+    capture->clients[capture->num_clients++] = in;
+    ALOGV("capture_attach(): stream %p, %d clients", in, capture->num_clients);
+
+exit:
+    pthread_mutex_unlock(&capture->lock);
+    return ret;
+}
+
+/* must be called with hw device and input stream mutexes locked */
+static void capture_detach(struct tuna_stream_in *in)
+{
+    struct tuna_capture *capture = &in->dev->capture;
+    unsigned int i;
+
+    pthread_mutex_lock(&capture->lock);
+    for (i = 0; i < capture->num_clients; i++) {
+        if (capture->clients[i] == in)
+            break;
+    }
+    if (i < capture->num_clients) {
+        capture->num_clients--;
+        memmove(&capture->clients[i], &capture->clients[i + 1],
+                (capture->num_clients - i) * sizeof(capture->clients[0]));
+    }
+
+    if (capture->num_clients == 0 && capture->pcm != NULL) {
+        pcm_close(capture->pcm);
+        capture->pcm = NULL;
+        free(capture->ring);
+        capture->ring = NULL;
+    }
+    ALOGV("capture_detach(): stream %p, %d clients", in, capture->num_clients);
+    pthread_mutex_unlock(&capture->lock);
+}
+
+/* Copies the next capture period of the input stream from the shared ring into
+ * buffer, keeping only the first in->config.channels channels. The stream which
+ * is the most ahead reads the next period from the driver.
+ * must be called with input stream mutex locked */
+static int capture_read(struct tuna_stream_in *in, int16_t *buffer)
+{
+    struct tuna_capture *capture = &in->dev->capture;
+    size_t period_size = capture->config.period_size;
+    size_t src_channels = capture->config.channels;
+    size_t dst_channels = in->config.channels;
+    int16_t *src;
+    size_t i;
+    int ret = 0;
+
+    pthread_mutex_lock(&capture->lock);
+    while (in->capture_pos + period_size > capture->frames_written) {
+        src = capture->ring +
+                (capture->frames_written % capture->ring_frames) * src_channels;
+        AUDIO_TRACE_BEGIN("pcm_read");
+        ret = pcm_read(capture->pcm, src, pcm_frames_to_bytes(capture->pcm, period_size));
+        AUDIO_TRACE_END();
+        if (ret != 0)
+            goto exit;
+        capture->frames_written += period_size;
+    }
+
+    if (capture->frames_written - in->capture_pos > capture->ring_frames) {
+        ALOGW("capture_read(): stream %p overrun, %llu frames lost", in,
+              (unsigned long long)(capture->frames_written - in->capture_pos -
+                                   capture->ring_frames));
+        in->capture_pos = capture->frames_written - capture->ring_frames;
+    }
+    AUDIO_TRACE_INT("capture_ring_frames", capture->frames_written - in->capture_pos);
+
+    src = capture->ring + (in->capture_pos % capture->ring_frames) * src_channels;
+    if (dst_channels == src_channels) {
+        memcpy(buffer, src, in_frames_to_bytes(in, period_size));
+    } else {
+        for (i = period_size; i > 0; i--) {
+            memcpy(buffer, src, dst_channels * sizeof(int16_t));
+            buffer += dst_channels;
+            src += src_channels;
+        }
     }
+    in->capture_pos += period_size;
+
+exit:
+    pthread_mutex_unlock(&capture->lock);
+    return ret;
+}
+
+/* must be called with hw device and input stream mutexes locked */
+static int start_input_stream(struct tuna_stream_in *in)
+{
+    int ret = 0;
+    struct tuna_audio_device *adev = in->dev;
 
     if (in->aux_channels_changed)
     {
@@ -1493,18 +1978,27 @@ static int start_input_stream(struct tuna_stream_in *in)
                 in->main_channels, in->aux_channels, in->config.channels);
     }
 
+    /* join the running capture if possible, otherwise take the capture
+     * path over: this stream then selects the input route */
+    if (!can_share_capture(in)) {
+        force_input_standby(adev);
+        adev->active_input = in;
+
+        if (adev->mode != AUDIO_MODE_IN_CALL) {
+            adev->in_device = in->device;
+            select_input_device(adev);
+        }
+    }
+
     if (in->need_echo_reference && in->echo_reference == NULL)
         in->echo_reference = get_echo_reference(adev,
                                         AUDIO_FORMAT_PCM_16_BIT,
                                         popcount(in->main_channels),
                                         in->requested_rate);
 
-    /* this assumes routing is done previously */
-    in->pcm = pcm_open(0, PORT_MM2_UL, PCM_IN, &in->config);
-    if (!pcm_is_ready(in->pcm)) {
-        ALOGE("cannot open pcm_in driver: %s", pcm_get_error(in->pcm));
-        pcm_close(in->pcm);
-        adev->active_input = NULL;
+    if (capture_attach(in) != 0) {
+        if (adev->active_input == in)
+            adev->active_input = NULL;
         return -ENOMEM;
     }
 
@@ -1564,13 +2058,18 @@ static int do_input_standby(struct tuna_stream_in *in)
     struct tuna_audio_device *adev = in->dev;
 
     if (!in->standby) {
-        pcm_close(in->pcm);
-        in->pcm = NULL;
-
-        adev->active_input = 0;
-        if (adev->mode != AUDIO_MODE_IN_CALL) {
-            adev->in_device = AUDIO_DEVICE_NONE;
-            select_input_device(adev);
+        AUDIO_TRACE_BEGIN("do_input_standby");
+        capture_detach(in);
+
+        /* hand the input route over to a stream still capturing, if any */
+        if (adev->active_input == in) {
+            adev->active_input = adev->capture.num_clients ?
+                                    adev->capture.clients[0] : NULL;
+            if (adev->mode != AUDIO_MODE_IN_CALL) {
+                adev->in_device = adev->active_input ?
+                                    adev->active_input->device : AUDIO_DEVICE_NONE;
+                select_input_device(adev);
+            }
         }
 
         if (in->echo_reference != NULL) {
@@ -1581,6 +2080,7 @@ static int do_input_standby(struct tuna_stream_in *in)
         }
 
         in->standby = 1;
+        AUDIO_TRACE_END();
     }
     return 0;
 }
@@ -1665,15 +2165,25 @@ static void get_capture_delay(struct tuna_stream_in *in,
                        struct echo_reference_buffer *buffer)
 {
 
+    struct tuna_capture *capture = &in->dev->capture;
     /* read frames available in kernel driver buffer */
     size_t kernel_frames;
+    size_t ring_frames;
     struct timespec tstamp;
     long buf_delay;
     long rsmp_delay;
     long kernel_delay;
+    long ring_delay;
     long delay_ns;
+    int ret;
 
-    if (pcm_get_htimestamp(in->pcm, &kernel_frames, &tstamp) < 0) {
+    pthread_mutex_lock(&capture->lock);
+    ret = pcm_get_htimestamp(capture->pcm, &kernel_frames, &tstamp);
+    /* frames already read from the driver but not yet consumed by this stream */
+    ring_frames = (size_t)(capture->frames_written - in->capture_pos);
+    pthread_mutex_unlock(&capture->lock);
+
+    if (ret < 0) {
         buffer->time_stamp.tv_sec  = 0;
         buffer->time_stamp.tv_nsec = 0;
         buffer->delay_ns           = 0;
@@ -1697,16 +2207,17 @@ static void get_capture_delay(struct tuna_stream_in *in,
     }
 
     kernel_delay = (long)(((int64_t)kernel_frames * 1000000000) / in->config.rate);
+    ring_delay = (long)(((int64_t)ring_frames * 1000000000) / in->config.rate);
 
-    delay_ns = kernel_delay + buf_delay + rsmp_delay;
+    delay_ns = kernel_delay + ring_delay + buf_delay + rsmp_delay;
 
     buffer->time_stamp = tstamp;
     buffer->delay_ns   = delay_ns;
     ALOGV("get_capture_delay time_stamp = [%ld].[%ld], delay_ns: [%d],"
-         " kernel_delay:[%ld], buf_delay:[%ld], rsmp_delay:[%ld], kernel_frames:[%d], "
-         "in->read_buf_frames:[%d], in->proc_buf_frames:[%d], frames:[%d]",
+         " kernel_delay:[%ld], ring_delay:[%ld], buf_delay:[%ld], rsmp_delay:[%ld],"
+         " kernel_frames:[%d], in->read_buf_frames:[%d], in->proc_buf_frames:[%d], frames:[%d]",
          buffer->time_stamp.tv_sec , buffer->time_stamp.tv_nsec, buffer->delay_ns,
-         kernel_delay, buf_delay, rsmp_delay, kernel_frames,
+         kernel_delay, ring_delay, buf_delay, rsmp_delay, kernel_frames,
          in->read_buf_frames, in->proc_buf_frames, frames);
 
 }
@@ -1722,11 +2233,11 @@ static int32_t update_echo_reference(struct tuna_stream_in *in, size_t frames)
     if (in->ref_buf_frames < frames) {
         if (in->ref_buf_size < frames) {
             in->ref_buf_size = frames;
-            in->ref_buf = (int16_t *)realloc(in->ref_buf, pcm_frames_to_bytes(in->pcm, frames));
+            in->ref_buf = (int16_t *)realloc(in->ref_buf, in_frames_to_bytes(in, frames));
             ALOG_ASSERT((in->ref_buf != NULL),
                         "update_echo_reference() failed to reallocate ref_buf");
             ALOGV("update_echo_reference(): ref_buf %p extended to %d bytes",
-                      in->ref_buf, pcm_frames_to_bytes(in->pcm, frames));
+                      in->ref_buf, in_frames_to_bytes(in, frames));
         }
         b.frame_count = frames - in->ref_buf_frames;
         b.raw = (void *)(in->ref_buf + in->ref_buf_frames * in->config.channels);
@@ -1821,7 +2332,7 @@ static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
     in = (struct tuna_stream_in *)((char *)buffer_provider -
                                    offsetof(struct tuna_stream_in, buf_provider));
 
-    if (in->pcm == NULL) {
+    if (in->standby) {
         buffer->raw = NULL;
         buffer->frame_count = 0;
         in->read_status = -ENODEV;
@@ -1829,7 +2340,7 @@ static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
     }
 
     if (in->read_buf_frames == 0) {
-        size_t size_in_bytes = pcm_frames_to_bytes(in->pcm, in->config.period_size);
+        size_t size_in_bytes = in_frames_to_bytes(in, in->config.period_size);
         if (in->read_buf_size < in->config.period_size) {
             in->read_buf_size = in->config.period_size;
             in->read_buf = (int16_t *) realloc(in->read_buf, size_in_bytes);
@@ -1839,7 +2350,7 @@ static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
                   in->read_buf, size_in_bytes);
         }
 
-        in->read_status = pcm_read(in->pcm, (void*)in->read_buf, size_in_bytes);
+        in->read_status = capture_read(in, in->read_buf);
 
         if (in->read_status != 0) {
             ALOGE("get_next_buffer() pcm_read error %d", in->read_status);
@@ -1884,7 +2395,7 @@ static ssize_t read_frames(struct tuna_stream_in *in, void *buffer, ssize_t fram
         if (in->resampler != NULL) {
             in->resampler->resample_from_provider(in->resampler,
                                                   (int16_t *)((char *)buffer +
-                                                      pcm_frames_to_bytes(in->pcm ,frames_wr)),
+                                                      in_frames_to_bytes(in, frames_wr)),
                                                   &frames_rd);
 
         } else {
@@ -1895,9 +2406,9 @@ static ssize_t read_frames(struct tuna_stream_in *in, void *buffer, ssize_t fram
             get_next_buffer(&in->buf_provider, &buf);
             if (buf.raw != NULL) {
                 memcpy((char *)buffer +
-                            pcm_frames_to_bytes(in->pcm, frames_wr),
+                            in_frames_to_bytes(in, frames_wr),
                         buf.raw,
-                        pcm_frames_to_bytes(in->pcm, buf.frame_count));
+                        in_frames_to_bytes(in, buf.frame_count));
                 frames_rd = buf.frame_count;
             }
             release_buffer(&in->buf_provider, &buf);
@@ -1937,7 +2448,7 @@ static ssize_t process_frames(struct tuna_stream_in *in, void* buffer, ssize_t f
             ssize_t frames_rd;
 
             if (in->proc_buf_size < (size_t)frames) {
-                size_t size_in_bytes = pcm_frames_to_bytes(in->pcm, frames);
+                size_t size_in_bytes = in_frames_to_bytes(in, frames);
 
                 in->proc_buf_size = (size_t)frames;
                 in->proc_buf_in = (int16_t *)realloc(in->proc_buf_in, size_in_bytes);
@@ -1952,10 +2463,12 @@ static ssize_t process_frames(struct tuna_stream_in *in, void* buffer, ssize_t f
                 ALOGV("process_frames(): proc_buf_in %p extended to %d bytes",
                      in->proc_buf_in, size_in_bytes);
             }
+            AUDIO_TRACE_BEGIN("process_frames_read");
             frames_rd = read_frames(in,
                                     in->proc_buf_in +
                                         in->proc_buf_frames * in->config.channels,
                                     frames - in->proc_buf_frames);
+            AUDIO_TRACE_END();
             if (frames_rd < 0) {
                 frames_wr = frames_rd;
                 break;
@@ -1963,8 +2476,11 @@ static ssize_t process_frames(struct tuna_stream_in *in, void* buffer, ssize_t f
             in->proc_buf_frames += frames_rd;
         }
 
-        if (in->echo_reference != NULL)
+        if (in->echo_reference != NULL) {
+            AUDIO_TRACE_BEGIN("process_frames_echo_reference");
             push_echo_reference(in, in->proc_buf_frames);
+            AUDIO_TRACE_END();
+        }
 
          /* in_buf.frameCount and out_buf.frameCount indicate respectively
           * the maximum number of frames to be consumed and produced by process() */
@@ -1978,11 +2494,13 @@ static ssize_t process_frames(struct tuna_stream_in *in, void* buffer, ssize_t f
          * The generic solution is to have an output buffer for each effect and pass it as
          * input to the next.
          */
+        AUDIO_TRACE_BEGIN("process_frames_effects");
         for (i = 0; i < in->num_preprocessors; i++) {
             (*in->preprocessors[i].effect_itfe)->process(in->preprocessors[i].effect_itfe,
                                                &in_buf,
                                                &out_buf);
         }
+        AUDIO_TRACE_END();
 
         /* process() has updated the number of frames consumed and produced in
          * in_buf.frameCount and out_buf.frameCount respectively
@@ -2048,6 +2566,8 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
     struct tuna_audio_device *adev = in->dev;
     size_t frames_rq = bytes / audio_stream_in_frame_size(stream);
 
+    AUDIO_TRACE_BEGIN("in_read");
+
     /* acquiring hw device mutex systematically is useful if a low priority thread is waiting
      * on the input stream mutex - e.g. executing select_mode() while holding the hw device
      * mutex
@@ -2055,7 +2575,9 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
     pthread_mutex_lock(&adev->lock);
     pthread_mutex_lock(&in->lock);
     if (in->standby) {
+        AUDIO_TRACE_BEGIN("start_input_stream");
         ret = start_input_stream(in);
+        AUDIO_TRACE_END();
         if (ret == 0)
             in->standby = 0;
     }
@@ -2066,10 +2588,8 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
 
     if (in->num_preprocessors != 0)
         ret = process_frames(in, buffer, frames_rq);
-    else if (in->resampler != NULL)
-        ret = read_frames(in, buffer, frames_rq);
     else
-        ret = pcm_read(in->pcm, buffer, bytes);
+        ret = read_frames(in, buffer, frames_rq);
 
     if (ret > 0)
         ret = 0;
@@ -2083,6 +2603,7 @@ exit:
                in_get_sample_rate(&stream->common));
 
     pthread_mutex_unlock(&in->lock);
+    AUDIO_TRACE_END();
     return bytes;
 }
 
@@ -2752,11 +3273,8 @@ static int adev_set_mic_mute(struct audio_hw_device *dev, bool state)
         ril_set_mic_mute(adev->ril_handle, state);
         /* Not all devices work with the ril_set_mic_mute function.
          * the following change is acceptable if sec_mic_mute fails. */
-        unsigned int channel;
-        int volume = (state ? 0 : MIXER_ABE_GAIN_0DB);
-        for (channel = 0; channel < 2; channel++)
-            mixer_ctl_set_value(adev->mixer_ctls.voice_ul_volume,
-                                channel, volume);
+        ramp_gain(adev->mixer_ctls.voice_ul_volume,
+                  state ? 0 : MIXER_ABE_GAIN_0DB);
     }
 
     adev->mic_mute = state;
@@ -2903,6 +3421,7 @@ static int adev_close(hw_device_t *device)
     /* RIL */
     ril_close(adev->ril_handle);
 
+    unload_route_db(adev);
     mixer_close(adev->mixer);
     free(device);
     return 0;
@@ -3029,7 +3548,8 @@ static int adev_open(const hw_module_t* module, const char* name,
 
     /* Set the default route before the PCM stream is opened */
     pthread_mutex_lock(&adev->lock);
-    set_route_by_array(adev->mixer, defaults, 1);
+    init_routes(adev);
+    set_route(adev, ROUTE_DEFAULTS, 1);
     adev->mode = AUDIO_MODE_NORMAL;
     adev->out_device = AUDIO_DEVICE_OUT_SPEAKER;
     adev->in_device = AUDIO_DEVICE_IN_BUILTIN_MIC & ~AUDIO_DEVICE_BIT_IN;
@@ -21,6 +21,7 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <system/audio.h>
 #include <hardware/audio.h>
@@ -216,9 +217,20 @@
 #define CAPTURE_PERIOD_SIZE (ABE_BASE_FRAME_COUNT * CAPTURE_PERIOD_MS * MULTIPLIER_FACTOR)
 /* number of periods for capture */
 #define CAPTURE_PERIOD_COUNT 2
+/* number of capture periods kept in the ring shared by concurrent input streams */
+#define CAPTURE_RING_PERIOD_COUNT 8
+/* maximum number of input streams sharing the MM2_UL capture */
+#define MAX_CAPTURE_CLIENTS 4
 /* minimum sleep time in out_write() when write threshold is not reached */
 #define MIN_WRITE_SLEEP_US 5000
 
+/* number of interpolated mixer writes used to move an ABE gain to a new value */
+#define GAIN_RAMP_STEPS 8
+/* delay between two gain ramp steps in microseconds (full ramp = 3.5 ms) */
+#define GAIN_RAMP_STEP_US 500
+/* maximum number of ABE gains ramped together */
+#define MAX_GAIN_RAMPS 8
+
 #ifndef DEFAULT_OUT_SAMPLING_RATE
 #define DEFAULT_OUT_SAMPLING_RATE 44100
 #endif
@@ -362,6 +374,13 @@ struct mixer_ctls
     struct mixer_ctl *earpiece_volume;
 };
 
+struct gain_ramp
+{
+    struct mixer_ctl *ctl;
+    int start;
+    int target;
+};
+
 #define MAX_PREPROCESSORS 3 /* maximum one AGC + one NS + one AEC per input stream */
 
 struct effect_info_s {
@@ -381,7 +400,6 @@ struct tuna_stream_in {
 
     pthread_mutex_t lock;       /* see note below on mutex acquisition order */
     struct pcm_config config;
-    struct pcm *pcm;
     int device;
     struct resampler_itfe *resampler;
     struct resampler_buffer_provider buf_provider;
@@ -412,6 +430,10 @@ struct tuna_stream_in {
     bool aux_channels_changed;
     uint32_t main_channels;
     uint32_t aux_channels;
+
+    /* position of this stream in the shared capture ring, see struct tuna_capture */
+    uint64_t capture_pos;
+
     struct tuna_audio_device *dev;
 };
 
@@ -440,6 +462,79 @@ struct tuna_stream_out {
     unsigned int sample_rate;
 };
 
+/* MM2_UL is read once into a ring shared by all active input streams. Each
+ * stream copies its own channels out of the ring and keeps its own resampler
+ * and pre processing. The client list is protected by the hw device mutex,
+ * the pcm and ring by the capture mutex (taken after the input stream mutex). */
+struct tuna_capture {
+    pthread_mutex_t lock;
+    struct pcm *pcm;
+    struct pcm_config config;
+    int16_t *ring;
+    size_t ring_frames;
+    uint64_t frames_written;    /* frames read from the pcm since it was opened */
+    struct tuna_stream_in *clients[MAX_CAPTURE_CLIENTS];
+    unsigned int num_clients;
+};
+
+struct route_setting
+{
+    char *ctl_name;
+    int intval;
+    char *strval;
+    struct mixer_ctl *ctl;      /* resolved from ctl_name in adev_open() */
+};
+
+enum route_id {
+    ROUTE_DEFAULTS,
+    ROUTE_HF_OUTPUT,
+    ROUTE_HS_OUTPUT,
+    ROUTE_MM_UL2_BT,
+    ROUTE_MM_UL2_AMIC_LEFT,
+    ROUTE_MM_UL2_AMIC_RIGHT,
+    ROUTE_MM_UL2_AMIC_DUAL_MAIN_SUB,
+    ROUTE_MM_UL2_AMIC_DUAL_SUB_MAIN,
+    ROUTE_VX_UL_AMIC_LEFT,
+    ROUTE_VX_UL_AMIC_RIGHT,
+    ROUTE_VX_UL_BT,
+    ROUTE_TOTAL
+};
+
+/* Route database file, generated at build time from audio_routes.txt by
+ * gen_route_db.py. Routes it contains replace the built-in ones below.
+ * All fields are little endian, string fields are offsets in the string
+ * table which ends the file. */
+#define ROUTE_DB_PATH "/system/etc/audio_routes.bin"
+#define ROUTE_DB_MAGIC 0x42445254   /* "TRDB" */
+#define ROUTE_DB_VERSION 1
+#define ROUTE_DB_NO_STRING 0xffffffff
+
+struct route_db_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_routes;
+    uint32_t num_settings;
+    uint32_t strings_size;
+};
+
+struct route_db_route {
+    uint32_t name;
+    uint32_t first_setting;
+    uint32_t num_settings;
+};
+
+struct route_db_setting {
+    uint32_t ctl_name;
+    uint32_t strval;            /* ROUTE_DB_NO_STRING for integer controls */
+    int32_t intval;
+};
+
+struct route_db {
+    void *map;
+    size_t map_size;
+    struct route_setting *settings;
+};
+
 struct tuna_audio_device {
     struct audio_hw_device hw_device;
 
@@ -453,7 +548,8 @@ struct tuna_audio_device {
     struct pcm *pcm_modem_ul;
     int in_call;
     float voice_volume;
-    struct tuna_stream_in *active_input;
+    struct tuna_stream_in *active_input;    /* input stream selecting the capture route */
+    struct tuna_capture capture;
     struct tuna_stream_out *outputs[OUTPUT_TOTAL];
     bool mic_mute;
     int tty_mode;
@@ -462,18 +558,20 @@ struct tuna_audio_device {
     int wb_amr;
     bool screen_off;
 
+    /* call setup running concurrently with mixer programming, see select_mode() */
+    pthread_t call_setup_thread;
+    bool call_setup_pending;
+    struct timespec call_setup_start;
+
+    /* routes in use, built-in or loaded from the route database */
+    struct route_setting *routes[ROUTE_TOTAL];
+    struct route_db route_db;
+
     /* RIL */
     void *ril_handle;
 };
 
 
-struct route_setting
-{
-    char *ctl_name;
-    int intval;
-    char *strval;
-};
-
 /* These are values that never change */
 struct route_setting defaults[] = {
     /* general */
@@ -712,6 +810,25 @@ struct route_setting vx_ul_bt[] = {
     },
 };
 
+struct route_table_entry {
+    const char *name;
+    struct route_setting *settings;
+};
+
+/* built-in routes, indexed by enum route_id */
+const struct route_table_entry route_table[ROUTE_TOTAL] = {
+    [ROUTE_DEFAULTS] = { "defaults", defaults },
+    [ROUTE_HF_OUTPUT] = { "hf_output", hf_output },
+    [ROUTE_HS_OUTPUT] = { "hs_output", hs_output },
+    [ROUTE_MM_UL2_BT] = { "mm_ul2_bt", mm_ul2_bt },
+    [ROUTE_MM_UL2_AMIC_LEFT] = { "mm_ul2_amic_left", mm_ul2_amic_left },
+    [ROUTE_MM_UL2_AMIC_RIGHT] = { "mm_ul2_amic_right", mm_ul2_amic_right },
+    [ROUTE_MM_UL2_AMIC_DUAL_MAIN_SUB] = { "mm_ul2_amic_dual_main_sub", mm_ul2_amic_dual_main_sub },
+    [ROUTE_MM_UL2_AMIC_DUAL_SUB_MAIN] = { "mm_ul2_amic_dual_sub_main", mm_ul2_amic_dual_sub_main },
+    [ROUTE_VX_UL_AMIC_LEFT] = { "vx_ul_amic_left", vx_ul_amic_left },
+    [ROUTE_VX_UL_AMIC_RIGHT] = { "vx_ul_amic_right", vx_ul_amic_right },
+    [ROUTE_VX_UL_BT] = { "vx_ul_bt", vx_ul_bt },
+};
 
 #define STRING_TO_ENUM(string) { #string, string }
 
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TUNA_AUDIO_TRACE_H
+#define TUNA_AUDIO_TRACE_H
+
+/* Trace markers written to the kernel trace_marker through atrace, visible
+ * with systrace/atrace when the "audio" category is enabled. They are only
+ * built with TARGET_TUNA_AUDIO_TRACE := true and compile to nothing otherwise.
+ * Must be included before any other header that may include cutils/trace.h. */
+
+#ifdef AUDIO_HW_TRACE
+
+#define ATRACE_TAG ATRACE_TAG_AUDIO
+#include <cutils/trace.h>
+
+#define AUDIO_TRACE_BEGIN(name) ATRACE_BEGIN(name)
+#define AUDIO_TRACE_END() ATRACE_END()
+#define AUDIO_TRACE_INT(name, value) ATRACE_INT(name, value)
+
+#else
+
+#define AUDIO_TRACE_BEGIN(name) do { } while (0)
+#define AUDIO_TRACE_END() do { } while (0)
+#define AUDIO_TRACE_INT(name, value) do { } while (0)
+
+#endif
+
+#endif /* !TUNA_AUDIO_TRACE_H */
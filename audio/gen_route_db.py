@@ -0,0 +1,93 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2011 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Compile the text route description (audio_routes.txt) into the binary
+route database loaded by the audio HAL (see struct route_db_header in
+audio_hw.h).
+
+usage: gen_route_db.py <audio_routes.txt> <audio_routes.bin>"""
+
+import struct
+import sys
+
+ROUTE_DB_MAGIC = 0x42445254
+ROUTE_DB_VERSION = 1
+ROUTE_DB_NO_STRING = 0xffffffff
+
+
+def ParseRoutes(path):
+  routes = []
+  with open(path) as f:
+    for lineno, line in enumerate(f, 1):
+      line = line.strip()
+      if not line or line.startswith("#"):
+        continue
+      if line.startswith("[") and line.endswith("]"):
+        routes.append((line[1:-1].strip(), []))
+        continue
+      if not routes or "=" not in line:
+        raise ValueError("%s:%d: expected [route] or <control> = <value>"
+                         % (path, lineno))
+      ctl, value = [x.strip() for x in line.split("=", 1)]
+      if len(value) >= 2 and value.startswith('"') and value.endswith('"'):
+        routes[-1][1].append((ctl, value[1:-1], 0))
+      else:
+        routes[-1][1].append((ctl, None, int(value, 0)))
+  return routes
+
+
+def BuildDatabase(routes):
+  strings = bytearray()
+  offsets = {}
+
+  def AddString(s):
+    if s not in offsets:
+      offsets[s] = len(strings)
+      strings.extend(s.encode("utf-8") + b"\0")
+    return offsets[s]
+
+  route_data = bytearray()
+  setting_data = bytearray()
+  num_settings = 0
+  for name, settings in routes:
+    route_data += struct.pack("<III", AddString(name), num_settings,
+                              len(settings))
+    for ctl, strval, intval in settings:
+      if strval is None:
+        strval_offset = ROUTE_DB_NO_STRING
+      else:
+        strval_offset = AddString(strval)
+      setting_data += struct.pack("<IIi", AddString(ctl), strval_offset,
+                                  intval)
+      num_settings += 1
+
+  header = struct.pack("<IIIII", ROUTE_DB_MAGIC, ROUTE_DB_VERSION,
+                       len(routes), num_settings, len(strings))
+  return bytes(header + route_data + setting_data + strings)
+
+
+def main(argv):
+  if len(argv) != 3:
+    sys.stderr.write(__doc__ + "\n")
+    return 1
+  data = BuildDatabase(ParseRoutes(argv[1]))
+  with open(argv[2], "wb") as f:
+    f.write(data)
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main(sys.argv))
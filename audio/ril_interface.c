@@ -109,6 +109,11 @@ int ril_close(void *ril_handle)
     return 0;
 }
 
+int ril_connect(void *ril_handle)
+{
+    return ril_connect_if_required(ril_handle);
+}
+
 int ril_set_call_volume(void *ril_handle, enum _SoundType sound_type,
                         float volume)
 {
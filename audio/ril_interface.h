@@ -26,6 +26,7 @@
 /* Function prototypes */
 int ril_open(void *ril_handle);
 int ril_close(void *ril_handle);
+int ril_connect(void *ril_handle);
 int ril_set_call_volume(void *ril_handle, enum _SoundType sound_type,
                         float volume);
 int ril_set_call_audio_path(void *ril_handle, enum _AudioPath path);
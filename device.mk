@@ -80,6 +80,11 @@ endif
 PRODUCT_COPY_FILES += \
 	$(DEVICE_FOLDER)/audio/audio_effects.conf:system/vendor/etc/audio_effects.conf
 
+ifeq ($(TARGET_TUNA_AUDIO_ROUTE_DB),true)
+PRODUCT_PACKAGES += \
+	audio_routes.bin
+endif
+
 # Symlinks
 PRODUCT_PACKAGES += \
 	libpn544_fw.so \
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TUNA_SYSFS_ATTR_H
+#define TUNA_SYSFS_ATTR_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * Integer sysfs attribute kept open for the lifetime of its user. The last
+ * value written is remembered so that writing the same value again does not
+ * reach the kernel.
+ */
+struct sysfs_attr {
+    int fd;
+    int cached;             /* value holds what the attribute was set to */
+    long long value;
+};
+
+#define SYSFS_ATTR_INIT { -1, 0, 0 }
+
+static inline int sysfs_attr_open(struct sysfs_attr *attr, const char *path)
+{
+    attr->cached = 0;
+    attr->fd = open(path, O_RDWR | O_CLOEXEC);
+    return attr->fd < 0 ? -errno : 0;
+}
+
+static inline void sysfs_attr_close(struct sysfs_attr *attr)
+{
+    if (attr->fd >= 0)
+        close(attr->fd);
+    attr->fd = -1;
+    attr->cached = 0;
+}
+
+static inline int sysfs_attr_write(struct sysfs_attr *attr, long long value)
+{
+    char buf[24];
+    int len;
+
+    if (attr->cached && attr->value == value)
+        return 0;
+    if (attr->fd < 0)
+        return -EBADF;
+
+    len = snprintf(buf, sizeof(buf), "%lld\n", value);
+    if (pwrite(attr->fd, buf, len, 0) < 0) {
+        attr->cached = 0;
+        return -errno;
+    }
+
+    attr->cached = 1;
+    attr->value = value;
+    return 0;
+}
+
+#endif /* TUNA_SYSFS_ATTR_H */
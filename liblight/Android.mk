@@ -26,7 +26,9 @@ LOCAL_SHARED_LIBRARIES := liblog
 
 LOCAL_MODULE := lights.tuna
 
-LOCAL_C_INCLUDES := $(LOCAL_PATH)/../kernel-headers
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../include \
+	$(LOCAL_PATH)/../kernel-headers
 
 LOCAL_MODULE_TAGS := optional
 
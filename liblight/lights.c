@@ -26,6 +26,7 @@
 #include <sys/types.h>
 #include <hardware/lights.h>
 #include <linux/leds-an30259a.h>
+#include <sysfs_attr.h>
 
 static pthread_once_t g_init = PTHREAD_ONCE_INIT;
 static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -57,35 +58,18 @@ enum LED_Type {
 // a "stack" of virtual LED states
 static struct an30259a_pr_control g_led_states[LED_TYPE_LAST];
 
+// the backlight and LED nodes stay open, brightness is set very often
+static struct sysfs_attr g_lcd_brightness = SYSFS_ATTR_INIT;
+static int g_led_fd = -1;
+static struct an30259a_pr_control g_led_current;
+static int g_led_current_valid;
+
 void init_g_lock(void)
 {
 	pthread_mutex_init(&g_lock, NULL);
 	memset(g_led_states, 0, sizeof(g_led_states));
-}
-
-static int write_int(char const *path, int value)
-{
-	int fd;
-	static int already_warned;
-
-	already_warned = 0;
-
-	ALOGV("write_int: path %s, value %d", path, value);
-	fd = open(path, O_RDWR);
-
-	if (fd >= 0) {
-		char buffer[20];
-		int bytes = sprintf(buffer, "%d\n", value);
-		int amt = write(fd, buffer, bytes);
-		close(fd);
-		return amt == -1 ? -errno : 0;
-	} else {
-		if (already_warned == 0) {
-			ALOGE("write_int failed to open %s\n", path);
-			already_warned = 1;
-		}
-		return -errno;
-	}
+	if (sysfs_attr_open(&g_lcd_brightness, LCD_FILE) < 0)
+		ALOGE("failed to open %s", LCD_FILE);
 }
 
 static int rgb_to_brightness(struct light_state_t const *state)
@@ -103,7 +87,8 @@ static int set_light_backlight(struct light_device_t *dev __unused,
 	int brightness = rgb_to_brightness(state);
 
 	pthread_mutex_lock(&g_lock);
-	err = write_int(LCD_FILE, brightness);
+	ALOGV("set_light_backlight: brightness %d", brightness);
+	err = sysfs_attr_write(&g_lcd_brightness, brightness);
 
 	pthread_mutex_unlock(&g_lock);
 	return err;
@@ -123,26 +108,36 @@ static int write_leds(struct an30259a_pr_control *led)
 {
 	int err = 0;
 	int imax = IMAX;
-	int fd;
 
 	pthread_mutex_lock(&g_lock);
 
-	fd = open(LED_FILE, O_RDWR);
-	if (fd >= 0) {
-		err = ioctl(fd, AN30259A_PR_SET_IMAX, &imax);
+	if (g_led_current_valid &&
+	    !memcmp(&g_led_current, led, sizeof(*led)))
+		goto out;
+
+	if (g_led_fd < 0) {
+		g_led_fd = open(LED_FILE, O_RDWR | O_CLOEXEC);
+		if (g_led_fd < 0) {
+			ALOGE("failed to open %s!", LED_FILE);
+			err = -errno;
+			goto out;
+		}
+
+		err = ioctl(g_led_fd, AN30259A_PR_SET_IMAX, &imax);
 		if (err)
 			ALOGE("failed to set imax");
+	}
 
-		err = ioctl(fd, AN30259A_PR_SET_LED, led);
-		if (err < 0)
-			ALOGE("failed to set leds!");
-
-		close(fd);
+	err = ioctl(g_led_fd, AN30259A_PR_SET_LED, led);
+	if (err < 0) {
+		ALOGE("failed to set leds!");
+		g_led_current_valid = 0;
 	} else {
-		ALOGE("failed to open %s!", LED_FILE);
-		err =  -errno;
+		g_led_current = *led;
+		g_led_current_valid = 1;
 	}
 
+out:
 	pthread_mutex_unlock(&g_lock);
 
 	return err;
@@ -26,6 +26,7 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_MODULE_TAGS := optional
 
 LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../include \
 	$(LOCAL_PATH)/mlsdk/platform/include \
 	$(LOCAL_PATH)/mlsdk/platform/include/linux \
 	$(LOCAL_PATH)/mlsdk/platform/linux \
@@ -38,6 +39,8 @@ LOCAL_SRC_FILES := \
 	sensors.cpp \
 	SensorBase.cpp \
 	MPLSensor.cpp \
+	SampleClock.cpp \
+	HostFusion.cpp \
 	InputEventReader.cpp \
 	LightSensor.cpp \
 	ProximitySensor.cpp \
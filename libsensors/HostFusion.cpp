@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include <cutils/log.h>
+
+#include "HostFusion.h"
+
+/*****************************************************************************/
+
+// time constant of the accel and compass correction is about 1 / kp seconds
+#define DEFAULT_KP          1.0f
+#define DEFAULT_KI          0.01f
+// bound of the learned gyro bias, so a clipped gyro can not wind it up
+#define MAX_BIAS            0.1f
+
+static float norm3(float *v)
+{
+    float n = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+    if (n > 0) {
+        v[0] /= n;
+        v[1] /= n;
+        v[2] /= n;
+    }
+    return n;
+}
+
+static void cross3(const float *a, const float *b, float *c)
+{
+    c[0] = a[1] * b[2] - a[2] * b[1];
+    c[1] = a[2] * b[0] - a[0] * b[2];
+    c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+HostFusion::HostFusion()
+    : mKp(DEFAULT_KP), mKi(DEFAULT_KI)
+{
+    reset();
+}
+
+void HostFusion::reset()
+{
+    mQ[0] = 1;
+    mQ[1] = mQ[2] = mQ[3] = 0;
+    mBias[0] = mBias[1] = mBias[2] = 0;
+    mInitialized = false;
+    mHaveHeading = false;
+}
+
+void HostFusion::setGains(float kp, float ki)
+{
+    mKp = kp;
+    mKi = ki;
+}
+
+/* start from the attitude given by the accel and the compass alone */
+void HostFusion::align(const float *a, const float *m)
+{
+    float up[3] = { a[0], a[1], a[2] };
+    float east[3], north[3];
+    float r[9];
+    float w, x, y, z, t;
+
+    norm3(up);
+    if (m) {
+        cross3(m, up, east);
+    } else {
+        // no heading reference: put north along the device y axis
+        static const float ref[3] = { 0, 1, 0 };
+        cross3(ref, up, east);
+    }
+    if (norm3(east) == 0) {
+        static const float ref[3] = { 1, 0, 0 };
+        cross3(up, ref, north);
+        norm3(north);
+        cross3(north, up, east);
+    }
+    cross3(up, east, north);
+
+    // the rows of the device to world rotation are east, north and up
+    for (int i = 0; i < 3; i++) {
+        r[i] = east[i];
+        r[3 + i] = north[i];
+        r[6 + i] = up[i];
+    }
+
+    t = r[0] + r[4] + r[8];
+    if (t > 0) {
+        float s = sqrtf(t + 1.0f) * 2;
+        w = 0.25f * s;
+        x = (r[7] - r[5]) / s;
+        y = (r[2] - r[6]) / s;
+        z = (r[3] - r[1]) / s;
+    } else if (r[0] > r[4] && r[0] > r[8]) {
+        float s = sqrtf(1.0f + r[0] - r[4] - r[8]) * 2;
+        w = (r[7] - r[5]) / s;
+        x = 0.25f * s;
+        y = (r[1] + r[3]) / s;
+        z = (r[2] + r[6]) / s;
+    } else if (r[4] > r[8]) {
+        float s = sqrtf(1.0f + r[4] - r[0] - r[8]) * 2;
+        w = (r[2] - r[6]) / s;
+        x = (r[1] + r[3]) / s;
+        y = 0.25f * s;
+        z = (r[5] + r[7]) / s;
+    } else {
+        float s = sqrtf(1.0f + r[8] - r[0] - r[4]) * 2;
+        w = (r[3] - r[1]) / s;
+        x = (r[2] + r[6]) / s;
+        y = (r[5] + r[7]) / s;
+        z = 0.25f * s;
+    }
+
+    mQ[0] = w;
+    mQ[1] = x;
+    mQ[2] = y;
+    mQ[3] = z;
+    mInitialized = true;
+    mHaveHeading = m != NULL;
+}
+
+void HostFusion::update(const float *gyro, const float *accel,
+                        const float *mag, float dt)
+{
+    float a[3] = { accel[0], accel[1], accel[2] };
+    float m[3];
+    float e[3] = { 0, 0, 0 };
+    float g[3];
+    bool haveMag = false;
+
+    if (norm3(a) == 0)
+        return;
+    if (mag) {
+        m[0] = mag[0];
+        m[1] = mag[1];
+        m[2] = mag[2];
+        haveMag = norm3(m) != 0;
+    }
+
+    // the compass often has no sample yet for the first packets, align again
+    // on its first one rather than slowly pulling the heading around
+    if (!mInitialized || (haveMag && !mHaveHeading)) {
+        align(a, haveMag ? m : NULL);
+        return;
+    }
+
+    // propagate with the gyro first, so that the accel and the compass are
+    // compared with the attitude of the same sample and not the previous one
+    for (int i = 0; i < 3; i++)
+        g[i] = gyro[i] + mBias[i];
+    rotate(g, dt);
+
+    float w = mQ[0], x = mQ[1], y = mQ[2], z = mQ[3];
+
+    // estimated direction of up in the device frame, third row of the
+    // device to world rotation
+    float v[3] = {
+        2 * (x * z - w * y),
+        2 * (y * z + w * x),
+        1 - 2 * (x * x + y * y),
+    };
+    cross3(a, v, e);
+
+    if (haveMag) {
+        // rotate the field to the world frame and keep only its horizontal
+        // magnitude along north, so the compass corrects the heading only
+        float r0[3] = { 1 - 2 * (y * y + z * z), 2 * (x * y - w * z),
+                        2 * (x * z + w * y) };
+        float r1[3] = { 2 * (x * y + w * z), 1 - 2 * (x * x + z * z),
+                        2 * (y * z - w * x) };
+        float hx = r0[0] * m[0] + r0[1] * m[1] + r0[2] * m[2];
+        float hy = r1[0] * m[0] + r1[1] * m[1] + r1[2] * m[2];
+        float hz = v[0] * m[0] + v[1] * m[1] + v[2] * m[2];
+        float bn = sqrtf(hx * hx + hy * hy);
+        float b[3], em[3];
+
+        for (int i = 0; i < 3; i++)
+            b[i] = bn * r1[i] + hz * v[i];
+        cross3(m, b, em);
+        for (int i = 0; i < 3; i++)
+            e[i] += em[i];
+    }
+
+    for (int i = 0; i < 3; i++) {
+        mBias[i] += mKi * e[i] * dt;
+        if (mBias[i] > MAX_BIAS)
+            mBias[i] = MAX_BIAS;
+        else if (mBias[i] < -MAX_BIAS)
+            mBias[i] = -MAX_BIAS;
+        g[i] = mKp * e[i];
+    }
+    rotate(g, dt);
+}
+
+/* integrate dq/dt = q * (0, g) / 2 over dt, g in rad/s in the device frame */
+void HostFusion::rotate(const float *g, float dt)
+{
+    float w = mQ[0], x = mQ[1], y = mQ[2], z = mQ[3];
+    float h = 0.5f * dt;
+
+    mQ[0] = w + h * (-x * g[0] - y * g[1] - z * g[2]);
+    mQ[1] = x + h * (w * g[0] + y * g[2] - z * g[1]);
+    mQ[2] = y + h * (w * g[1] - x * g[2] + z * g[0]);
+    mQ[3] = z + h * (w * g[2] + x * g[1] - y * g[0]);
+
+    float n = sqrtf(mQ[0] * mQ[0] + mQ[1] * mQ[1] + mQ[2] * mQ[2] +
+                    mQ[3] * mQ[3]);
+    for (int i = 0; i < 4; i++)
+        mQ[i] /= n;
+}
+
+void HostFusion::getQuaternion(long *quat) const
+{
+    for (int i = 0; i < 4; i++)
+        quat[i] = (long)(mQ[i] * 1073741824.0f);
+}
+
+void HostFusion::getGravity(long *gravity) const
+{
+    float w = mQ[0], x = mQ[1], y = mQ[2], z = mQ[3];
+
+    gravity[0] = (long)(2 * (x * z - w * y) * 65536.0f);
+    gravity[1] = (long)(2 * (y * z + w * x) * 65536.0f);
+    gravity[2] = (long)((1 - 2 * (x * x + y * y)) * 65536.0f);
+}
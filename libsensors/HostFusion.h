@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HOST_FUSION_H
+#define ANDROID_HOST_FUSION_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+/*
+ * Attitude estimator run on the application processor.
+ *
+ * A complementary filter on the calibrated gyro, accel and compass samples:
+ * the gyro rate is integrated, and the drift is pulled back toward the
+ * gravity and magnetic north measured by the accel and the compass, with a
+ * proportional and an integral (gyro bias) term.
+ *
+ * The attitude is the rotation from the device frame to the east-north-up
+ * world frame, and is given in the fixed point formats of the MPL outputs
+ * so it can stand in for the DMP quaternion.
+ */
+class HostFusion
+{
+    float mQ[4];            // w, x, y, z
+    float mBias[3];         // integral term, rad/s
+    float mKp;
+    float mKi;
+    bool mInitialized;
+    bool mHaveHeading;      // aligned on a compass sample
+
+    void align(const float *a, const float *m);
+    void rotate(const float *g, float dt);
+
+public:
+    HostFusion();
+    void reset();
+    void setGains(float kp, float ki);
+
+    /* gyro in rad/s, accel in any unit, mag in any unit or NULL, dt in s */
+    void update(const float *gyro, const float *accel, const float *mag,
+                float dt);
+    bool valid() const { return mInitialized; }
+
+    /* unit quaternion w, x, y, z in q30, like inv_get_quaternion() */
+    void getQuaternion(long *quat) const;
+    /* gravity in g in the device frame in q16, like inv_get_gravity() */
+    void getGravity(long *gravity) const;
+};
+
+/*****************************************************************************/
+
+#endif  /* ANDROID_HOST_FUSION_H */
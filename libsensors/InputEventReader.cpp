@@ -108,3 +108,18 @@ void InputEventCircularReader::next()
         mCurr = mBuffer;
     }
 }
+
+/* number of buffered events of the given type and code, current one included */
+size_t InputEventCircularReader::countEvents(int type, int code) const
+{
+    const struct input_event* e = mCurr;
+    size_t n = 0;
+
+    for (size_t i = mFreeSpace; i < mEvents; i++) {
+        if (e->type == type && e->code == code)
+            n++;
+        if (++e >= mBufferEnd)
+            e = mBuffer;
+    }
+    return n;
+}
@@ -41,6 +41,7 @@ public:
     ssize_t fill(int fd);
     bool readEvent(int fd, input_event const** events);
     void next();
+    size_t countEvents(int type, int code) const;
 };
 
 /*****************************************************************************/
@@ -28,8 +28,10 @@
 #include <sys/select.h>
 #include <dlfcn.h>
 #include <pthread.h>
+#include <time.h>
 
 #include <cutils/log.h>
+#include <cutils/properties.h>
 #include <utils/KeyedVector.h>
 
 #include "MPLSensor.h"
@@ -37,6 +39,7 @@
 #include "math.h"
 #include "ml.h"
 #include "mlFIFO.h"
+#include "mlMathFunc.h"
 #include "mlsl.h"
 #include "mlos.h"
 #include "ml_stored_data.h"
@@ -62,12 +65,28 @@ extern "C" {
 #define VFUNC_LOG ALOGV_IF(EXTRA_VERBOSE, "%s", __PRETTY_FUNCTION__)
 /* this mask must turn on only the sensors that are present and managed by the MPL */
 #define ALL_MPL_SENSORS_NP (INV_THREE_AXIS_ACCEL | INV_THREE_AXIS_COMPASS | INV_THREE_AXIS_GYRO)
+/* the DMP samples at 200Hz, the timer irq path is limited to 100Hz */
+#define DMP_MIN_DELAY_NS   5000000LLU
+#define MIN_DELAY_NS       10000000LLU
+/* "dmp" for the DMP quaternion, "host" for the HostFusion estimator, read
+ * again whenever the first fusion sensor is enabled */
+#define FUSION_PROPERTY    "persist.sensors.fusion"
+/* set to 1 to log the delay from each resume to its first sample */
+#define RESUME_PROPERTY    "debug.sensors.resume"
 
 #define CALL_MEMBER_FN(pobject,ptrToMember)  ((pobject)->*(ptrToMember))
 
 /******************************************/
 
 static unsigned long long irq_timestamp = 0;
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 /* ***************************************************************************
  * MPL interface misc.
  */
@@ -113,6 +132,12 @@ void setCallbackObject(MPLSensor* gbpt)
 #define LA_ENABLED ((1<<ID_LA) & enabled_sensors)
 #define GR_ENABLED ((1<<ID_GR) & enabled_sensors)
 #define RV_ENABLED ((1<<ID_RV) & enabled_sensors)
+#define GYU_ENABLED ((1<<ID_GYU) & enabled_sensors)
+#define MU_ENABLED  ((1<<ID_MU)  & enabled_sensors)
+#define GRV_ENABLED ((1<<ID_GRV) & enabled_sensors)
+/* the sensors computed from the attitude */
+#define FUSION_SENSORS ((1<<Orientation) | (1<<RotationVector) | \
+                        (1<<LinearAccel) | (1<<Gravity))
 
 MPLSensor::MPLSensor() :
     SensorBase(NULL),
@@ -124,7 +149,13 @@ MPLSensor::MPLSensor() :
             mUseTimerIrqAccel(false), mUsetimerIrqCompass(true),
             mUseTimerirq(false),
             mEnabled(0), mPendingMask(0),
-            mForceSleep(false), mNineAxisEnabled(false)
+            mDerived(0), mUseHostFusion(false), mFusionDt(0),
+            mFifoEvents(0),
+            mBatchHead(0), mBatchCount(0), mBatchDeadline(INT64_MAX),
+            mDraining(false), mFlushPending(0),
+            mForceSleep(false), mResumeTime(0), mResumeLatency(0),
+            mMaxResumeLatency(0), mLogResume(false), mTimerPeriodMs(0),
+            mNineAxisEnabled(false)
 {
     FUNC_LOG;
     int mpu_int_fd;
@@ -210,6 +241,19 @@ MPLSensor::MPLSensor() :
     mPendingEvents[Orientation].type = SENSOR_TYPE_ORIENTATION;
     mPendingEvents[Orientation].orientation.status = SENSOR_STATUS_ACCURACY_HIGH;
 
+    mPendingEvents[GyroUncalibrated].version = sizeof(sensors_event_t);
+    mPendingEvents[GyroUncalibrated].sensor = ID_GYU;
+    mPendingEvents[GyroUncalibrated].type = SENSOR_TYPE_GYROSCOPE_UNCALIBRATED;
+
+    mPendingEvents[MagneticFieldUncalibrated].version = sizeof(sensors_event_t);
+    mPendingEvents[MagneticFieldUncalibrated].sensor = ID_MU;
+    mPendingEvents[MagneticFieldUncalibrated].type =
+        SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED;
+
+    mPendingEvents[GameRotationVector].version = sizeof(sensors_event_t);
+    mPendingEvents[GameRotationVector].sensor = ID_GRV;
+    mPendingEvents[GameRotationVector].type = SENSOR_TYPE_GAME_ROTATION_VECTOR;
+
     mHandlers[RotationVector] = &MPLSensor::rvHandler;
     mHandlers[LinearAccel] = &MPLSensor::laHandler;
     mHandlers[Gravity] = &MPLSensor::gravHandler;
@@ -217,9 +261,16 @@ MPLSensor::MPLSensor() :
     mHandlers[Accelerometer] = &MPLSensor::accelHandler;
     mHandlers[MagneticField] = &MPLSensor::compassHandler;
     mHandlers[Orientation] = &MPLSensor::orienHandler;
+    mHandlers[GyroUncalibrated] = &MPLSensor::gyroUncalHandler;
+    mHandlers[MagneticFieldUncalibrated] = &MPLSensor::compassUncalHandler;
+    mHandlers[GameRotationVector] = &MPLSensor::grvHandler;
 
-    for (int i = 0; i < numSensors; i++)
+    for (int i = 0; i < numSensors; i++) {
         mDelays[i] = 30000000LLU; // 30 ms by default
+        mDecimation[i] = 1;
+        mDecimCount[i] = 0;
+        mBatchTimeouts[i] = 0;
+    }
 
     if (inv_serial_start(port) != INV_SUCCESS) {
         ALOGE("Fatal Error : could not open MPL serial interface");
@@ -269,6 +320,8 @@ void MPLSensor::clearIrqData(bool* irq_set)
             if (nread > 0) {
                 irq_set[i] = true;
                 irq_timestamp = irqdata.irqtime;
+                inv_serial_trace(MLSL_TRACE_IRQ, i, INV_SUCCESS, nread,
+                                 (unsigned char *)&irqdata);
             }
         }
         mPollFds[i].revents = 0;
@@ -285,22 +338,25 @@ void MPLSensor::setPowerStates(int enabled_sensors)
 
     if (LA_ENABLED || GR_ENABLED || RV_ENABLED || O_ENABLED) {
         mLocalSensorMask = ALL_MPL_SENSORS_NP;
-    } else if (!A_ENABLED && !M_ENABLED && !GY_ENABLED) {
+    } else if (!A_ENABLED && !M_ENABLED && !GY_ENABLED &&
+               !GYU_ENABLED && !MU_ENABLED && !GRV_ENABLED) {
         mLocalSensorMask = 0;
     } else {
-        if (GY_ENABLED) {
+        /* the game rotation vector is the 6-axis DMP attitude, so it keeps
+         * the compass off */
+        if (GY_ENABLED || GYU_ENABLED || GRV_ENABLED) {
             mLocalSensorMask |= INV_THREE_AXIS_GYRO;
         } else {
             mLocalSensorMask &= ~INV_THREE_AXIS_GYRO;
         }
 
-        if (A_ENABLED) {
+        if (A_ENABLED || GRV_ENABLED) {
             mLocalSensorMask |= (INV_THREE_AXIS_ACCEL);
         } else {
             mLocalSensorMask &= ~(INV_THREE_AXIS_ACCEL);
         }
 
-        if (M_ENABLED) {
+        if (M_ENABLED || MU_ENABLED) {
             mLocalSensorMask |= INV_THREE_AXIS_COMPASS;
         } else {
             mLocalSensorMask &= ~(INV_THREE_AXIS_COMPASS);
@@ -419,6 +475,12 @@ void MPLSensor::initMPL()
         ALOGE("libinvensense_mpl.so not found, 9x sensor fusion disabled (%s)",error);
     }
 
+    selectFusion();
+    if (mUseHostFusion) {
+        /* the host estimator needs only the raw gyro, accel and compass */
+        mNineAxisEnabled = true;
+    }
+
     if (inv_set_bias_update(bias_update_mask) != INV_SUCCESS) {
         ALOGE("Error : Bias update function could not be set.\n");
     }
@@ -510,9 +572,106 @@ void MPLSensor::cbOnMotion(uint16_t val)
 }
 
 
+/**
+ * called by inv_update_data() for every FIFO packet, with the mMplMutex held.
+ * the MPL outputs only hold the values of the packet being processed, so the
+ * events are generated here. The packet index is stored as the timestamp until
+ * readEvents() knows how many packets were read.
+ */
 void MPLSensor::cbProcData()
 {
-    mNewData = 1;
+    /* the derived outputs are those of the new packet */
+    mDerived = 0;
+
+    if (mUseHostFusion && (mEnabled & FUSION_SENSORS))
+        updateHostFusion();
+
+    /* each sensor only gets the packets matching its own rate */
+    for (int i = 0; i < numSensors; i++) {
+        if ((mEnabled & (1 << i)) && --mDecimCount[i] <= 0) {
+            mDecimCount[i] = mDecimation[i];
+            CALL_MEMBER_FN(this,mHandlers[i])(mPendingEvents + i,
+                                              &mPendingMask, i);
+        }
+    }
+
+    for (int j = 0; mPendingMask && j < numSensors; j++) {
+        if (mPendingMask & (1 << j)) {
+            mPendingMask &= ~(1 << j);
+            if (mEnabled & (1 << j)) {
+                mPendingEvents[j].timestamp = mNewData;
+                queueEvent(mPendingEvents + j, j);
+                mFifoEvents++;
+            }
+        }
+    }
+
+    mNewData++;
+}
+
+/* pick the engine of the fusion sensors from FUSION_PROPERTY. The sensor list
+ * is built once, so a device without the 9 axis library only lists the fusion
+ * sensors if "host" was set at boot. Either way the DMP stays powered, since
+ * its FIFO carries the gyro and accel packets: "host" replaces the DMP
+ * quaternion, it does not save the DMP power. Called at init, then from
+ * enable() with the mMplMutex held. */
+void MPLSensor::selectFusion()
+{
+    char fusion[PROPERTY_VALUE_MAX];
+
+    property_get(FUSION_PROPERTY, fusion, "dmp");
+    bool host = !strcmp(fusion, "host");
+    if (host != mUseHostFusion) {
+        ALOGI("using the %s sensor fusion", host ? "host" : "DMP");
+        mUseHostFusion = host;
+        mHostFusion.reset();
+    }
+}
+
+/* run the host estimator on the gyro, accel and compass of the current FIFO
+ * packet. Must be called with the mMplMutex held. */
+void MPLSensor::updateHostFusion()
+{
+    float gyro[3], accel[3], mag[3];
+
+    if (inv_get_gyro_float(gyro) != INV_SUCCESS ||
+            inv_get_accel_float(accel) != INV_SUCCESS)
+        return;
+    for (int i = 0; i < 3; i++)
+        gyro[i] = gyro[i] * M_PI / 180.0;
+
+    mHostFusion.update(gyro, accel,
+                       inv_get_magnetometer_float(mag) == INV_SUCCESS ?
+                       mag : NULL, mFusionDt);
+}
+
+/* period of the FIFO packets, in ns */
+static int64_t fifo_period_ns()
+{
+    struct mldl_cfg *mldl_cfg = inv_get_dl_config();
+
+    if (mldl_cfg->requested_sensors & INV_DMP_PROCESSOR)
+        return (int64_t)(inv_get_fifo_rate() + 1) *
+            inv_mpu_get_sampling_period_us(mldl_cfg) * 1000LL;
+    return (int64_t)inv_get_sample_step_size_ms() * 1000000LL;
+}
+
+/**
+ * the last FIFO packet was read at irq_timestamp. The packet times are taken
+ * from the model of the sensor clock fit on the irq timestamps.
+ * Must be called with the mMplMutex held.
+ */
+void MPLSensor::stampFifoEvents()
+{
+    int n = mFifoEvents < mBatchCount ? mFifoEvents : mBatchCount;
+
+    mSampleClock.update(irq_timestamp, mNewData, fifo_period_ns());
+
+    for (int i = mBatchCount - n; i < mBatchCount; i++) {
+        sensors_event_t *event =
+            &mBatchEvents[(mBatchHead + i) % MPL_BATCH_EVENTS];
+        event->timestamp = mSampleClock.timestamp(event->timestamp);
+    }
 }
 
 // these handlers transform mpl data into one of the Android sensor types.
@@ -576,23 +735,69 @@ void MPLSensor::compassHandler(sensors_event_t* s, uint32_t* pending_mask,
         *pending_mask |= (1 << index);
 }
 
+/* the quaternion, the rotation matrix and gravity are shared by several
+ * handlers. They are computed once per FIFO packet, and only if a handler
+ * due on this packet needs them. */
+const long* MPLSensor::derivedQuaternion()
+{
+    if (!(mDerived & DERIVED_QUATERNION)) {
+        if (mUseHostFusion) {
+            if (!mHostFusion.valid())
+                return NULL;
+            mHostFusion.getQuaternion(mQuat);
+        } else if (inv_get_quaternion(mQuat) != INV_SUCCESS) {
+            return NULL;
+        }
+        mDerived |= DERIVED_QUATERNION;
+    }
+    return mQuat;
+}
+
+const long* MPLSensor::derivedRotationMatrix()
+{
+    if (!(mDerived & DERIVED_ROT_MAT)) {
+        const long *quat = derivedQuaternion();
+        if (!quat)
+            return NULL;
+        inv_quaternion_to_rotation(quat, mRotMat);
+        mDerived |= DERIVED_ROT_MAT;
+    }
+    return mRotMat;
+}
+
+const long* MPLSensor::derivedGravity()
+{
+    if (!(mDerived & DERIVED_GRAVITY)) {
+        if (mUseHostFusion) {
+            if (!mHostFusion.valid())
+                return NULL;
+            mHostFusion.getGravity(mGravity);
+        } else if (inv_get_gravity(mGravity) != INV_SUCCESS) {
+            return NULL;
+        }
+        mDerived |= DERIVED_GRAVITY;
+    }
+    return mGravity;
+}
+
 void MPLSensor::rvHandler(sensors_event_t* s, uint32_t* pending_mask,
                            int index)
 {
     VFUNC_LOG;
     float quat[4];
     float norm = 0;
-    inv_error_t res;
-
-    res = inv_get_quaternion_float(quat);
+    const long *q = derivedQuaternion();
 
-    if (res != INV_SUCCESS) {
+    if (!q) {
         *pending_mask &= ~(1 << index);
         return;
     } else {
         *pending_mask |= (1 << index);
     }
 
+    for (int i = 0; i < 4; i++)
+        quat[i] = q[i] / 1073741824.0f;
+
     norm = quat[1] * quat[1] + quat[2] * quat[2] + quat[3] * quat[3]
             + FLT_EPSILON;
 
@@ -625,7 +830,16 @@ void MPLSensor::laHandler(sensors_event_t* s, uint32_t* pending_mask,
 {
     VFUNC_LOG;
     inv_error_t res;
-    res = inv_get_linear_accel_float(s->gyro.v);
+    if (mUseHostFusion) {
+        const long *gravity = derivedGravity();
+        res = gravity ? inv_get_accel_float(s->gyro.v) : INV_ERROR;
+        if (res == INV_SUCCESS) {
+            for (int i = 0; i < 3; i++)
+                s->gyro.v[i] -= gravity[i] / 65536.0f;
+        }
+    } else {
+        res = inv_get_linear_accel_float(s->gyro.v);
+    }
     s->gyro.v[0] *= 9.81;
     s->gyro.v[1] *= 9.81;
     s->gyro.v[2] *= 9.81;
@@ -637,13 +851,13 @@ void MPLSensor::gravHandler(sensors_event_t* s, uint32_t* pending_mask,
                              int index)
 {
     VFUNC_LOG;
-    inv_error_t res;
-    res = inv_get_gravity_float(s->gyro.v);
-    s->gyro.v[0] *= 9.81;
-    s->gyro.v[1] *= 9.81;
-    s->gyro.v[2] *= 9.81;
-    if (res == INV_SUCCESS)
-        *pending_mask |= (1 << index);
+    const long *gravity = derivedGravity();
+    if (!gravity)
+        return;
+    s->gyro.v[0] = gravity[0] / 65536.0f * 9.81;
+    s->gyro.v[1] = gravity[1] / 65536.0f * 9.81;
+    s->gyro.v[2] = gravity[2] / 65536.0f * 9.81;
+    *pending_mask |= (1 << index);
 }
 
 void MPLSensor::calcOrientationSensor(float *R, float *values)
@@ -693,19 +907,92 @@ void MPLSensor::orienHandler(sensors_event_t* s, uint32_t* pending_mask,
                               int index) //note that this is the handler for the android 'orientation' sensor, not the mpl orientation output
 {
     VFUNC_LOG;
-    inv_error_t res;
     float rot_mat[9];
+    const long *rot = derivedRotationMatrix();
 
-    res = inv_get_rot_mat_float(rot_mat);
+    if (!rot) {
+        ALOGW("orienHandler: data not valid");
+        return;
+    }
+
+    for (int i = 0; i < 9; i++)
+        rot_mat[i] = rot[i] / 1073741824.0f;
 
     calcOrientationSensor(rot_mat, s->orientation.v);
 
     s->orientation.status = estimateCompassAccuracy();
 
+    *pending_mask |= (1 << index);
+}
+
+/* the uncalibrated outputs add the bias back to the calibrated sample, and
+ * report the bias along with it */
+void MPLSensor::gyroUncalHandler(sensors_event_t* s, uint32_t* pending_mask,
+                                 int index)
+{
+    VFUNC_LOG;
+    inv_error_t res;
+
+    res = inv_get_gyro_float(s->uncalibrated_gyro.uncalib);
     if (res == INV_SUCCESS)
-        *pending_mask |= (1 << index);
-    else
-        ALOGW("orienHandler: data not valid (%d)", (int) res);
+        res = inv_get_gyro_bias_float(s->uncalibrated_gyro.bias);
+    if (res != INV_SUCCESS)
+        return;
+
+    for (int i = 0; i < 3; i++) {
+        s->uncalibrated_gyro.bias[i] *= M_PI / 180.0;
+        s->uncalibrated_gyro.uncalib[i] = s->uncalibrated_gyro.uncalib[i] *
+            M_PI / 180.0 + s->uncalibrated_gyro.bias[i];
+    }
+    *pending_mask |= (1 << index);
+}
+
+void MPLSensor::compassUncalHandler(sensors_event_t* s, uint32_t* pending_mask,
+                                    int index)
+{
+    VFUNC_LOG;
+    inv_error_t res;
+
+    res = inv_get_magnetometer_float(s->uncalibrated_magnetic.uncalib);
+    if (res == INV_SUCCESS)
+        res = inv_get_magnetometer_bias_float(s->uncalibrated_magnetic.bias);
+    if (res != INV_SUCCESS) {
+        ALOGW("compassUncalHandler: data not valid (%d)", res);
+        return;
+    }
+
+    for (int i = 0; i < 3; i++)
+        s->uncalibrated_magnetic.uncalib[i] += s->uncalibrated_magnetic.bias[i];
+    *pending_mask |= (1 << index);
+}
+
+/* the quaternion the DMP computes from the gyro and the accel only, before
+ * the compass correction of the 9-axis fusion */
+void MPLSensor::grvHandler(sensors_event_t* s, uint32_t* pending_mask,
+                           int index)
+{
+    VFUNC_LOG;
+    long q[4];
+    float quat[4];
+
+    if (inv_get_6axis_quaternion(q) != INV_SUCCESS)
+        return;
+
+    for (int i = 0; i < 4; i++)
+        quat[i] = q[i] / 1073741824.0f;
+
+    if (quat[0] < 0.0) {
+        quat[1] = -quat[1];
+        quat[2] = -quat[2];
+        quat[3] = -quat[3];
+        quat[0] = -quat[0];
+    }
+
+    s->data[0] = quat[1];
+    s->data[1] = quat[2];
+    s->data[2] = quat[3];
+    s->data[3] = quat[0];
+    *pending_mask |= (1 << index);
 }
 
 int MPLSensor::enable(int32_t handle, int en)
@@ -723,13 +1010,19 @@ int MPLSensor::enable(int32_t handle, int en)
     pthread_mutex_lock(&mMplMutex);
     if ((uint32_t(newState) << what) != (mEnabled & (1 << what))) {
         short flags = newState;
+        if (newState && ((1 << what) & FUSION_SENSORS) &&
+                !(mEnabled & FUSION_SENSORS))
+            selectFusion();
         mEnabled &= ~(1 << what);
         mEnabled |= (uint32_t(flags) << what);
         ALOGV_IF(EXTRA_VERBOSE, "mEnabled = %x", mEnabled);
         setPowerStates(mEnabled);
+        if (!(mEnabled & FUSION_SENSORS))
+            mHostFusion.reset();
         pthread_mutex_unlock(&mMplMutex);
-        if (!newState)
-            update_delay();
+        /* batch() may have set the delay before the sensor was enabled,
+         * when update_delay() still ignored it */
+        update_delay();
         return err;
     }
     pthread_mutex_unlock(&mMplMutex);
@@ -756,6 +1049,29 @@ int MPLSensor::setDelay(int32_t handle, int64_t ns)
     return update_delay();
 }
 
+/* number of FIFO packets between two events of each sensor, so that a fast
+ * sensor does not drive all the others at its rate. Without the DMP, the
+ * timer irq does not follow the FIFO rate and every packet is reported.
+ * must be called with the mMplMutex held. */
+void MPLSensor::updateDecimation()
+{
+    bool dmp = inv_get_dl_config()->requested_sensors & INV_DMP_PROCESSOR;
+    int64_t period = dmp ? fifo_period_ns() : 0;
+
+    mFusionDt = fifo_period_ns() / 1000000000.0f;
+
+    for (int i = 0; i < numSensors; i++) {
+        int decimation = period > 0 ? int(mDelays[i] / uint64_t(period)) : 1;
+
+        if (decimation < 1)
+            decimation = 1;
+        if (decimation != mDecimation[i]) {
+            mDecimation[i] = decimation;
+            mDecimCount[i] = 0;
+        }
+    }
+}
+
 int MPLSensor::update_delay()
 {
     FUNC_LOG;
@@ -773,14 +1089,17 @@ int MPLSensor::update_delay()
             }
         }
 
-        //Limit all rates to 100Hz max. 100Hz = 10ms = 10000000ns
-        if (wanted < 10000000LLU) {
-            wanted = 10000000LLU;
+        bool dmp = inv_get_dl_config()->requested_sensors & INV_DMP_PROCESSOR;
+
+        //Limit the rates to the 200Hz DMP rate, 100Hz without the DMP
+        uint64_t min_delay = dmp ? DMP_MIN_DELAY_NS : MIN_DELAY_NS;
+        if (wanted < min_delay) {
+            wanted = min_delay;
         }
 
         int rate = ((wanted) / 5000000LLU) - ((wanted % 5000000LLU == 0) ? 1
                                                                          : 0); //mpu fifo rate is in increments of 5ms
-        if (rate == 0) //KLP disallow fifo rate 0
+        if (rate == 0 && !dmp) //KLP disallow fifo rate 0 for the timer irq
             rate = 1;
 
         if (rate != mCurFifoRate) {
@@ -792,19 +1111,23 @@ int MPLSensor::update_delay()
             rv = (res == INV_SUCCESS);
         }
 
+        updateDecimation();
+
         if ((inv_get_dl_config()->requested_sensors & INV_DMP_PROCESSOR) == 0) {
             if (mUseTimerirq) {
                 ioctl(mIrqFds.valueFor(TIMERIRQ_FD), TIMERIRQ_STOP, 0);
                 clearIrqData(irq_set);
                 if (inv_get_dl_config()->requested_sensors
                         == INV_THREE_AXIS_COMPASS) {
+                    mTimerPeriodMs = wanted / 1000000LLU;
                     ioctl(mIrqFds.valueFor(TIMERIRQ_FD), TIMERIRQ_START,
-                          (unsigned long) (wanted / 1000000LLU));
+                          mTimerPeriodMs);
                     ALOGV_IF(EXTRA_VERBOSE, "updated timerirq period to %d",
                             (int) (wanted / 1000000LLU));
                 } else {
+                    mTimerPeriodMs = inv_get_sample_step_size_ms();
                     ioctl(mIrqFds.valueFor(TIMERIRQ_FD), TIMERIRQ_START,
-                          (unsigned long) inv_get_sample_step_size_ms());
+                          mTimerPeriodMs);
                     ALOGV_IF(EXTRA_VERBOSE, "updated timerirq period to %d",
                             (int) inv_get_sample_step_size_ms());
                 }
@@ -828,6 +1151,8 @@ int MPLSensor::readEvents(sensors_event_t* data, int count)
     clearIrqData(irq_set);
 
     pthread_mutex_lock(&mMplMutex);
+    mNewData = 0;
+    mFifoEvents = 0;
     if (mDmpStarted) {
         rv = inv_update_data();
         ALOGE_IF(rv != INV_SUCCESS, "inv_update_data error (code %d)", (int) rv);
@@ -837,37 +1162,132 @@ int MPLSensor::readEvents(sensors_event_t* data, int count)
                 "MPLSensor::readEvents called, but there's nothing to do.");
     }
 
-    pthread_mutex_unlock(&mMplMutex);
+    if (mResumeTime && mNewData) {
+        mResumeLatency = now_ns() - mResumeTime;
+        if (mResumeLatency > mMaxResumeLatency)
+            mMaxResumeLatency = mResumeLatency;
+        ALOGD_IF(mLogResume, "first sample %lld us after resume (max %lld us)",
+                 (long long)mResumeLatency / 1000,
+                 (long long)mMaxResumeLatency / 1000);
+        mResumeTime = 0;
+    }
 
-    if (!mNewData) {
+    /* google timestamp */
+    if (mNewData)
+        stampFifoEvents();
+    else
         ALOGV_IF(EXTRA_VERBOSE, "no new data");
-        return 0;
+
+    numEventReceived = drainBatch(data, count);
+
+    pthread_mutex_unlock(&mMplMutex);
+    return numEventReceived;
+}
+
+/* queue an event until the max report latency of its sensor expires.
+ * must be called with the mMplMutex held. */
+void MPLSensor::queueEvent(const sensors_event_t *event, int what)
+{
+    if (mBatchCount == MPL_BATCH_EVENTS) {
+        ALOGW("batch queue full, dropping oldest event");
+        mBatchHead = (mBatchHead + 1) % MPL_BATCH_EVENTS;
+        mBatchCount--;
     }
-    mNewData = 0;
 
-    /* google timestamp */
-    pthread_mutex_lock(&mMplMutex);
-    for (int i = 0; i < numSensors; i++) {
-        if (mEnabled & (1 << i)) {
-            CALL_MEMBER_FN(this,mHandlers[i])(mPendingEvents + i,
-                                              &mPendingMask, i);
-            mPendingEvents[i].timestamp = irq_timestamp;
+    mBatchEvents[(mBatchHead + mBatchCount) % MPL_BATCH_EVENTS] = *event;
+    mBatchCount++;
+
+    int64_t deadline = now_ns() + mBatchTimeouts[what];
+    if (deadline < mBatchDeadline)
+        mBatchDeadline = deadline;
+}
+
+/* deliver the queued events once the earliest report deadline has passed,
+ * the queue is getting full or a flush was requested. Events of sensors which
+ * are not batched have a zero timeout and are therefore delivered right away.
+ * must be called with the mMplMutex held. */
+int MPLSensor::drainBatch(sensors_event_t *data, int count)
+{
+    int numEvents = 0;
+
+    if (mBatchCount && (mFlushPending || mBatchCount >= MPL_BATCH_EVENTS * 3 / 4 ||
+                        now_ns() >= mBatchDeadline))
+        mDraining = true;
+
+    while (mDraining && count && mBatchCount) {
+        sensors_event_t *event = &mBatchEvents[mBatchHead];
+
+        mBatchHead = (mBatchHead + 1) % MPL_BATCH_EVENTS;
+        mBatchCount--;
+        if (mEnabled & (1 << handleToDriver(event->sensor))) {
+            *data++ = *event;
+            count--;
+            numEvents++;
         }
     }
 
-    for (int j = 0; count && mPendingMask && j < numSensors; j++) {
-        if (mPendingMask & (1 << j)) {
-            mPendingMask &= ~(1 << j);
-            if (mEnabled & (1 << j)) {
-                *data++ = mPendingEvents[j];
-                count--;
-                numEventReceived++;
-            }
+    if (mBatchCount)
+        return numEvents;
+
+    mDraining = false;
+    mBatchDeadline = INT64_MAX;
+
+    /* all the events preceding the flush requests have been delivered */
+    for (int i = 0; count && mFlushPending && i < numSensors; i++) {
+        if (mFlushPending & (1 << i)) {
+            mFlushPending &= ~(1 << i);
+            memset(data, 0, sizeof(*data));
+            data->version = META_DATA_VERSION;
+            data->type = SENSOR_TYPE_META_DATA;
+            data->meta_data.what = META_DATA_FLUSH_COMPLETE;
+            data->meta_data.sensor = mPendingEvents[i].sensor;
+            data++;
+            count--;
+            numEvents++;
         }
     }
 
+    return numEvents;
+}
+
+bool MPLSensor::hasPendingEvents() const
+{
+    return mDraining || mFlushPending;
+}
+
+int MPLSensor::batch(int32_t handle, int flags __unused, int64_t period_ns,
+                     int64_t timeout)
+{
+    FUNC_LOG;
+    int what = handleToDriver(handle);
+
+    if (uint32_t(what) >= numSensors || timeout < 0)
+        return -EINVAL;
+
+    pthread_mutex_lock(&mMplMutex);
+    mBatchTimeouts[what] = timeout;
     pthread_mutex_unlock(&mMplMutex);
-    return numEventReceived;
+
+    return setDelay(handle, period_ns);
+}
+
+int MPLSensor::flush(int32_t handle)
+{
+    FUNC_LOG;
+    int what = handleToDriver(handle);
+    int err = 0;
+
+    if (uint32_t(what) >= numSensors)
+        return -EINVAL;
+
+    pthread_mutex_lock(&mMplMutex);
+    if (mEnabled & (1 << what))
+        mFlushPending |= (1 << what);
+    else
+        err = -EINVAL;
+    pthread_mutex_unlock(&mMplMutex);
+
+    return err;
 }
 
 int MPLSensor::getFd() const
@@ -909,14 +1329,35 @@ void MPLSensor::handlePowerEvent()
     ioctl(fd, MPU_PM_EVENT_HANDLED, 0);
 }
 
+/* the FIFO rate, the FIFO contents and the requested sensors are kept by
+ * the MPL and the driver across a suspend. Only the DMP is stopped, so that
+ * the resume does not go through the whole setPowerStates() sequence. */
 void MPLSensor::sleepEvent()
 {
     VFUNC_LOG;
+    bool irq_set[5] = { false, false, false, false, false };
+
     pthread_mutex_lock(&mMplMutex);
-    if (mEnabled != 0) {
+    if (mEnabled != 0 && mDmpStarted) {
         mForceSleep = true;
         mOldEnabledMask = mEnabled;
-        setPowerStates(0);
+
+        inv_error_t rv = inv_dmp_stop();
+        ALOGE_IF(rv != INV_SUCCESS, "error: unable to stop DMP (retcode = %d)",
+                 rv);
+        if (mUseTimerirq)
+            ioctl(mIrqFds.valueFor(TIMERIRQ_FD), TIMERIRQ_STOP, 0);
+        clearIrqData(irq_set);
+        mDmpStarted = false;
+
+        /* store the calibration now rather than on the resume path */
+        if (mHaveGoodMpuCal || mHaveGoodCompassCal) {
+            rv = inv_store_calibration();
+            ALOGE_IF(rv != INV_SUCCESS,
+                     "error: unable to store MPL calibration file");
+            mHaveGoodMpuCal = false;
+            mHaveGoodCompassCal = false;
+        }
     }
     pthread_mutex_unlock(&mMplMutex);
 }
@@ -926,20 +1367,44 @@ void MPLSensor::wakeEvent()
     VFUNC_LOG;
     pthread_mutex_lock(&mMplMutex);
     if (mForceSleep) {
-        setPowerStates((mOldEnabledMask | mEnabled));
+        unsigned long sen_mask = mLocalSensorMask & mMasterSensorMask;
+
+        if (!mDmpStarted && sen_mask != 0 && mEnabled == mOldEnabledMask &&
+                inv_get_dl_config()->requested_sensors == sen_mask) {
+            /* nothing changed while suspended, restart where we stopped */
+            inv_error_t rv = inv_dmp_start();
+            ALOGE_IF(rv != INV_SUCCESS, "unable to start dmp");
+            mDmpStarted = true;
+            if (mUseTimerirq)
+                ioctl(mIrqFds.valueFor(TIMERIRQ_FD), TIMERIRQ_START,
+                      mTimerPeriodMs);
+        } else {
+            setPowerStates((mOldEnabledMask | mEnabled));
+        }
         mForceSleep = false;
+
+        /* the sample clock and the decimation start over after the gap */
+        mSampleClock.reset();
+        for (int i = 0; i < numSensors; i++)
+            mDecimCount[i] = 0;
+
+        char value[PROPERTY_VALUE_MAX];
+        property_get(RESUME_PROPERTY, value, "0");
+        mLogResume = atoi(value) != 0;
+        mResumeTime = now_ns();
     }
     pthread_mutex_unlock(&mMplMutex);
 }
 
 /** fill in the sensor list based on which sensors are configured.
  *  return the number of configured sensors.
- *  parameter list must point to a memory region of at least 7*sizeof(sensor_t)
+ *  parameter list must point to a memory region of at least
+ *  numSensors*sizeof(sensor_t)
  *  parameter len gives the length of the buffer pointed to by list
  */
 int MPLSensor::populateSensorList(struct sensor_t *list, size_t len)
 {
-    int numsensors = 7;
+    int numsensors = numSensors;
 
     if (len < numsensors * sizeof(sensor_t)) {
         ALOGE("sensor list too small, not populating.");
@@ -947,10 +1412,18 @@ int MPLSensor::populateSensorList(struct sensor_t *list, size_t len)
     }
 
     if (!mNineAxisEnabled) {
-        /* no 9-axis sensors, zero fill that part of the list */
-        numsensors = 3;
-        memset(list + numsensors, 0, (7 - numsensors) * sizeof(struct sensor_t));
+        /* no 9-axis sensors: move the uncalibrated and the 6-axis sensors
+         * over them, and zero fill the rest of the list */
+        int nine = GyroUncalibrated - Orientation;
+        memmove(list + Orientation, list + GyroUncalibrated,
+                (numSensors - GyroUncalibrated) * sizeof(struct sensor_t));
+        numsensors = numSensors - nine;
+        memset(list + numsensors, 0, nine * sizeof(struct sensor_t));
     }
 
+    /* all the MPL sensors share the HAL batch queue */
+    for (int i = 0; i < numsensors; i++)
+        list[i].fifoMaxEventCount = MPL_BATCH_EVENTS;
+
     return numsensors;
 }
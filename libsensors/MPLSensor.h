@@ -27,8 +27,14 @@
 #include <utils/KeyedVector.h>
 #include "sensors.h"
 #include "SensorBase.h"
+#include "SampleClock.h"
+#include "HostFusion.h"
 
 /*****************************************************************************/
+
+/* number of events the HAL can hold back for batched MPL sensors */
+#define MPL_BATCH_EVENTS 512
+
 /** MPLSensor implementation which fits into the HAL example for crespo provided
  * * by Google.
  * * WARNING: there may only be one instance of MPLSensor, ever.
@@ -51,12 +57,18 @@ public:
         RotationVector,
         LinearAccel,
         Gravity,
+        GyroUncalibrated,
+        MagneticFieldUncalibrated,
+        GameRotationVector,
         numSensors
     };
 
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int enable(int32_t handle, int enabled);
     virtual int readEvents(sensors_event_t *data, int count);
+    virtual bool hasPendingEvents() const;
+    virtual int batch(int32_t handle, int flags, int64_t period_ns, int64_t timeout);
+    virtual int flush(int32_t handle);
     virtual int getFd() const;
     virtual int getAccelFd() const;
     virtual int getTimerFd() const;
@@ -82,10 +94,18 @@ protected:
     void laHandler(sensors_event_t *data, uint32_t *pendmask, int index);
     void gravHandler(sensors_event_t *data, uint32_t *pendmask, int index);
     void orienHandler(sensors_event_t *data, uint32_t *pendmask, int index);
+    void gyroUncalHandler(sensors_event_t *data, uint32_t *pendmask, int index);
+    void compassUncalHandler(sensors_event_t *data, uint32_t *pendmask, int index);
+    void grvHandler(sensors_event_t *data, uint32_t *pendmask, int index);
     void calcOrientationSensor(float *Rx, float *Val);
+    const long* derivedQuaternion();
+    const long* derivedRotationMatrix();
+    const long* derivedGravity();
+    void selectFusion();
+    void updateHostFusion();
     int estimateCompassAccuracy();
 
-    int mNewData; //flag indicating that the MPL calculated new output values
+    int mNewData; //number of FIFO packets processed by the last inv_update_data()
     int mDmpStarted;
     long mMasterSensorMask;
     long mLocalSensorMask;
@@ -106,6 +126,10 @@ protected:
 private:
 
     int update_delay();
+    void updateDecimation();
+    void queueEvent(const sensors_event_t *event, int what);
+    void stampFifoEvents();
+    int drainBatch(sensors_event_t *data, int count);
     int accel_fd;
     int timer_fd;
 
@@ -113,9 +137,46 @@ private:
     uint32_t mPendingMask;
     sensors_event_t mPendingEvents[numSensors];
     uint64_t mDelays[numSensors];
+
+    /* outputs of the current FIFO packet shared by the handlers */
+    enum {
+        DERIVED_QUATERNION  = 0x01,
+        DERIVED_ROT_MAT     = 0x02,
+        DERIVED_GRAVITY     = 0x04,
+    };
+    uint32_t mDerived;
+    long mQuat[4];
+    long mRotMat[9];
+    long mGravity[3];
+
+    /* attitude computed on the host instead of the DMP */
+    bool mUseHostFusion;
+    HostFusion mHostFusion;
+    float mFusionDt;            // s between two FIFO packets
+
+    int mDecimation[numSensors];    // FIFO packets per event
+    int mDecimCount[numSensors];    // FIFO packets left until the next event
     hfunc_t mHandlers[numSensors];
+
+    /* events generated from the FIFO packets of the last inv_update_data() */
+    int mFifoEvents;
+    SampleClock mSampleClock;
+
+    /* events held back until the max report latency of a sensor expires */
+    int64_t mBatchTimeouts[numSensors];
+    sensors_event_t mBatchEvents[MPL_BATCH_EVENTS];
+    int mBatchHead;
+    int mBatchCount;
+    int64_t mBatchDeadline;
+    bool mDraining;
+    uint32_t mFlushPending;
     bool mForceSleep;
     long int mOldEnabledMask;
+    int64_t mResumeTime;        // time of the last resume until its first sample
+    int64_t mResumeLatency;     // ns from the last resume to its first sample
+    int64_t mMaxResumeLatency;
+    bool mLogResume;            // RESUME_PROPERTY at the last resume
+    unsigned long mTimerPeriodMs;   // period of the timer irq when running
     android::KeyedVector<int, int> mIrqFds;
 
     bool mNineAxisEnabled;
@@ -136,6 +197,12 @@ private:
                 return RotationVector;
             case ID_LA:
                 return LinearAccel;
+            case ID_GYU:
+                return GyroUncalibrated;
+            case ID_MU:
+                return MagneticFieldUncalibrated;
+            case ID_GRV:
+                return GameRotationVector;
         }
         return handle;
     }
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <cutils/log.h>
+
+#include "SampleClock.h"
+
+/*****************************************************************************/
+
+// fits with less points are dominated by the interrupt latency
+#define MIN_FIT_POINTS      4
+// the sensor oscillator is within a few percent of its nominal rate
+#define MAX_DRIFT           0.05
+// an interrupt this many periods off the fit means samples were lost
+#define MAX_RESIDUAL        4
+
+SampleClock::SampleClock()
+{
+    reset();
+}
+
+void SampleClock::reset()
+{
+    mHead = 0;
+    mFill = 0;
+    mSamples = 0;
+    mNominalPeriod = 0;
+    mPeriod = 0;
+    mLastTime = 0;
+    mLastCount = 0;
+    mPrevTimestamp = 0;
+    mLastTimestamp = 0;
+}
+
+/* account for count samples, the last of which was read at irqTime */
+void SampleClock::update(int64_t irqTime, int count, int64_t nominalPeriod)
+{
+    if (count <= 0)
+        return;
+
+    mPrevTimestamp = mLastTimestamp;
+
+    if (nominalPeriod != mNominalPeriod) {
+        int64_t lastTimestamp = mLastTimestamp;
+
+        reset();
+        mNominalPeriod = nominalPeriod;
+        mPeriod = nominalPeriod;
+        mPrevTimestamp = lastTimestamp;
+    }
+
+    mSamples += count;
+    mLastCount = count;
+
+    if (mFill) {
+        int64_t predicted = mLastTime + int64_t(mPeriod * count);
+        int64_t residual = irqTime - predicted;
+
+        if (residual > MAX_RESIDUAL * mPeriod ||
+            residual < -MAX_RESIDUAL * mPeriod) {
+            ALOGV("sample clock lost sync (%lld ns off)", (long long)residual);
+            /* the fits read the window from slot 0 */
+            mFill = 0;
+            mHead = 0;
+            mPeriod = mNominalPeriod;
+        }
+    }
+
+    mIndex[mHead] = mSamples;
+    mTime[mHead] = irqTime;
+    mHead = (mHead + 1) % WINDOW;
+    if (mFill < WINDOW)
+        mFill++;
+
+    if (mFill < MIN_FIT_POINTS) {
+        mLastTime = irqTime;
+        mLastTimestamp = timestamp(count - 1);
+        return;
+    }
+
+    /* fit relative to the newest point to keep the precision of the doubles */
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = 0; i < mFill; i++) {
+        double x = double(mIndex[i] - mSamples);
+        double y = double(mTime[i] - irqTime);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double mx = sx / mFill;
+    double my = sy / mFill;
+    double var = sxx - sx * mx;
+    if (var > 0) {
+        double period = (sxy - sx * my) / var;
+        if (period > mNominalPeriod * (1 - MAX_DRIFT) &&
+            period < mNominalPeriod * (1 + MAX_DRIFT))
+            mPeriod = period;
+    }
+
+    /* the interrupt latency only ever delays the interrupt time, so the line
+     * is moved down to the earliest interrupt of the window */
+    double offset = 0;
+    for (int i = 0; i < mFill; i++) {
+        double d = double(mTime[i] - irqTime) - mPeriod * double(mIndex[i] - mSamples);
+        if (d < offset)
+            offset = d;
+    }
+    mLastTime = irqTime + int64_t(offset);
+    mLastTimestamp = timestamp(count - 1);
+}
+
+/* timestamp of the sample-th sample read by the last interrupt */
+int64_t SampleClock::timestamp(int sample) const
+{
+    int64_t t = mLastTime - int64_t(mPeriod * (mLastCount - 1 - sample));
+
+    /* keep the samples ordered when the fit moves back */
+    if (t <= mPrevTimestamp)
+        t = mPrevTimestamp + 1 + sample;
+    return t;
+}
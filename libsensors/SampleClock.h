@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SAMPLE_CLOCK_H
+#define ANDROID_SAMPLE_CLOCK_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+/*
+ * Model of the clock of a sensor FIFO.
+ *
+ * Every interrupt gives the kernel time at which the last of a known number
+ * of samples was read. The sample period and phase are fit with a least
+ * squares line over the last interrupts, which follows the drift of the
+ * sensor oscillator against the kernel clock and smooths the interrupt
+ * latency out of the sample timestamps.
+ */
+class SampleClock
+{
+    enum { WINDOW = 32 };
+
+    int64_t mIndex[WINDOW];     // index of the last sample of an interrupt
+    int64_t mTime[WINDOW];      // interrupt time
+    int mHead;
+    int mFill;
+
+    int64_t mSamples;           // samples read so far
+    int64_t mNominalPeriod;
+    double mPeriod;             // fitted period
+    int64_t mLastTime;          // fitted time of the last sample read
+    int mLastCount;             // samples read by the last interrupt
+    int64_t mPrevTimestamp;     // timestamp of the last sample of the interrupt before
+    int64_t mLastTimestamp;     // timestamp of the last sample read
+
+public:
+    SampleClock();
+    void reset();
+    void update(int64_t irqTime, int count, int64_t nominalPeriod);
+    int64_t timestamp(int sample) const;
+    int64_t period() const { return int64_t(mPeriod); }
+};
+
+/*****************************************************************************/
+
+#endif  /* ANDROID_SAMPLE_CLOCK_H */
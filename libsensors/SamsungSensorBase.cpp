@@ -55,12 +55,39 @@ int SamsungSensorBase::handleEnable(int en __unused) {
     return 0;
 }
 
+/* each sample takes an EV_ABS event per axis of the device and an EV_SYN */
+#define EVENTS_PER_SAMPLE   4
+/* the reader holds the events of this long a wakeup latency */
+#define READER_BURST_NS     200000000LL
+#define READER_MIN_EVENTS   8
+#define READER_MAX_EVENTS   64
+/* the coalesced updates are logged at most this often */
+#define COALESCE_REPORT_NS  10000000000LL
+
+size_t SamsungSensorBase::readerSize(int64_t min_delay_ns) {
+    int64_t events = READER_MIN_EVENTS;
+
+    if (min_delay_ns > 0)
+        events = READER_BURST_NS / min_delay_ns * EVENTS_PER_SAMPLE;
+    if (events < READER_MIN_EVENTS)
+        events = READER_MIN_EVENTS;
+    if (events > READER_MAX_EVENTS)
+        events = READER_MAX_EVENTS;
+    return events;
+}
+
 SamsungSensorBase::SamsungSensorBase(const char *data_name,
-                                     int sensor_code)
+                                     int sensor_code,
+                                     int64_t min_delay_ns)
     : SensorBase(data_name),
       mEnabled(true),
       mHasPendingEvent(false),
-      mInputReader(4),
+      mInputReader(readerSize(min_delay_ns)),
+      mCoalescedEvents(0),
+      mCoalescedReported(0),
+      mCoalesceReportTime(0),
+      mInputSysfsEnable(SYSFS_ATTR_INIT),
+      mInputSysfsPollDelay(SYSFS_ATTR_INIT),
       mSensorCode(sensor_code),
       mLock(PTHREAD_MUTEX_INITIALIZER)
 {
@@ -68,18 +95,17 @@ SamsungSensorBase::SamsungSensorBase(const char *data_name,
     memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
     if (!data_fd)
         return;
-    mInputSysfsEnable = makeSysfsName(input_name, "enable");
-    if (!mInputSysfsEnable) {
-        ALOGE("%s: unable to allocate mem for %s:enable", __func__,
-             data_name);
-        return;
-    }
-    mInputSysfsPollDelay = makeSysfsName(input_name, "poll_delay");
-    if (!mInputSysfsPollDelay) {
-        ALOGE("%s: unable to allocate mem for %s:poll_delay", __func__,
-             data_name);
-        return;
-    }
+
+    /* the attributes stay open, the framework sets them over and over */
+    char *name = makeSysfsName(input_name, "enable");
+    if (sysfs_attr_open(&mInputSysfsEnable, name) < 0)
+        ALOGE("%s: unable to open %s", __func__, name);
+    delete[] name;
+
+    name = makeSysfsName(input_name, "poll_delay");
+    if (sysfs_attr_open(&mInputSysfsPollDelay, name) < 0)
+        ALOGE("%s: unable to open %s", __func__, name);
+    delete[] name;
 
     int flags = fcntl(data_fd, F_GETFL, 0);
     fcntl(data_fd, F_SETFL, flags | O_NONBLOCK);
@@ -91,8 +117,8 @@ SamsungSensorBase::~SamsungSensorBase() {
     if (mEnabled) {
         enable(0, 0);
     }
-    delete[] mInputSysfsEnable;
-    delete[] mInputSysfsPollDelay;
+    sysfs_attr_close(&mInputSysfsEnable);
+    sysfs_attr_close(&mInputSysfsPollDelay);
 }
 
 int SamsungSensorBase::enable(int32_t handle __unused, int en)
@@ -100,40 +126,21 @@ int SamsungSensorBase::enable(int32_t handle __unused, int en)
     int err = 0;
     pthread_mutex_lock(&mLock);
     if (en != mEnabled) {
-        int fd;
-        fd = open(mInputSysfsEnable, O_RDWR);
-        if (fd >= 0) {
-            err = write(fd, en ? "1" : "0", 2);
-            close(fd);
-            if (err < 0) {
-                goto cleanup;
-            }
+        err = sysfs_attr_write(&mInputSysfsEnable, en ? 1 : 0);
+        if (!err) {
             mEnabled = en;
             err = handleEnable(en);
-        } else {
-            err = -1;
         }
     }
-cleanup:
     pthread_mutex_unlock(&mLock);
     return err;
 }
 
 int SamsungSensorBase::setDelay(int32_t handle __unused, int64_t ns)
 {
-    int fd;
-    int result = 0;
-    char buf[21];
+    int result;
     pthread_mutex_lock(&mLock);
-    fd = open(mInputSysfsPollDelay, O_RDWR);
-    if (fd < 0) {
-        result = -1;
-        goto done;
-    }
-    sprintf(buf, "%lld", ns);
-    write(fd, buf, strlen(buf)+1);
-    close(fd);
-done:
+    result = sysfs_attr_write(&mInputSysfsPollDelay, ns);
     pthread_mutex_unlock(&mLock);
     return result;
 }
@@ -152,6 +159,10 @@ int SamsungSensorBase::readEvents(sensors_event_t* data, int count)
 
     pthread_mutex_lock(&mLock);
     int numEventReceived = 0;
+    int coalesced = 0;
+    // updates buffered from the current event on. The reader only refills
+    // once empty, so they are counted on the first update of each fill.
+    size_t updates = 0;
 
     if (mHasPendingEvent) {
         mHasPendingEvent = false;
@@ -167,7 +178,16 @@ int SamsungSensorBase::readEvents(sensors_event_t* data, int count)
     while (count && mInputReader.readEvent(data_fd, &event)) {
         if (event->type == EV_ABS) {
             if (event->code == mSensorCode) {
-                if (mEnabled && handleEvent(event)) {
+                if (!updates)
+                    updates = mInputReader.countEvents(EV_ABS, mSensorCode);
+                // when more updates are buffered than there is room for,
+                // only the newest ones are reported. The older ones used to
+                // stay in the reader for the next call; they are dropped
+                // instead, since they are already superseded and would only
+                // reach the framework later still.
+                if (updates-- > size_t(count)) {
+                    coalesced++;
+                } else if (mEnabled && handleEvent(event)) {
                     mPendingEvent.timestamp = timevalToNano(event->time);
                     *data++ = mPendingEvent;
                     count--;
@@ -178,6 +198,19 @@ int SamsungSensorBase::readEvents(sensors_event_t* data, int count)
         mInputReader.next();
     }
 
+    if (coalesced) {
+        int64_t now = getTimestamp();
+
+        mCoalescedEvents += coalesced;
+        if (now - mCoalesceReportTime >= COALESCE_REPORT_NS) {
+            ALOGI("%s: %lu updates dropped for newer ones (%lu total)",
+                  data_name, mCoalescedEvents - mCoalescedReported,
+                  mCoalescedEvents);
+            mCoalescedReported = mCoalescedEvents;
+            mCoalesceReportTime = now;
+        }
+    }
+
 done:
     pthread_mutex_unlock(&mLock);
     return numEventReceived;
@@ -22,6 +22,8 @@
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
+#include <sysfs_attr.h>
+
 #include "sensors.h"
 #include "SensorBase.h"
 #include "SamsungSensorBase.h"
@@ -34,13 +36,17 @@ protected:
     bool mEnabled;
     bool mHasPendingEvent;
     InputEventCircularReader mInputReader;
+    unsigned long mCoalescedEvents;
+    unsigned long mCoalescedReported;   // mCoalescedEvents at the last report
+    int64_t mCoalesceReportTime;
     sensors_event_t mPendingEvent;
-    char *mInputSysfsEnable;
-    char *mInputSysfsPollDelay;
+    struct sysfs_attr mInputSysfsEnable;
+    struct sysfs_attr mInputSysfsPollDelay;
     int mSensorCode;
     pthread_mutex_t mLock;
 
     static int64_t getTimestamp();
+    static size_t readerSize(int64_t min_delay_ns);
     static int64_t timevalToNano(timeval const& t) {
         return t.tv_sec*1000000000LL + t.tv_usec*1000;
     }
@@ -53,7 +59,8 @@ protected:
 
 public:
     SamsungSensorBase(const char* data_name,
-                      int sensor_code);
+                      int sensor_code,
+                      int64_t min_delay_ns = 0);
 
     virtual ~SamsungSensorBase();
     virtual int enable(int32_t handle, int en);
@@ -17,7 +17,9 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <math.h>
+#include <limits.h>
 #include <poll.h>
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
@@ -58,41 +60,99 @@ bool SensorBase::hasPendingEvents() const {
     return false;
 }
 
-int SensorBase::openInput(const char* inputName) {
-    int fd = -1;
-    const char *dirname = "/dev/input";
-    char devname[PATH_MAX];
-    char *filename;
+int SensorBase::batch(int32_t handle, int flags __unused, int64_t period_ns,
+                      int64_t timeout __unused) {
+    return setDelay(handle, period_ns);
+}
+
+int SensorBase::flush(int32_t handle __unused) {
+    return -ENOSYS;
+}
+
+/* nodes of /dev/input, indexed once by scanInputs() for all the drivers */
+#define INPUT_DIR           "/dev/input"
+#define MAX_INPUT_DEVICES   32
+
+struct input_device {
+    char name[80];
+    char node[NAME_MAX + 1];
+    int fd;     // opened by the scan and not yet claimed by a driver, or -1
+};
+
+static input_device sInputDevices[MAX_INPUT_DEVICES];
+static int sNumInputDevices = -1;   // -1 until scanned
+
+void SensorBase::scanInputs() {
     DIR *dir;
     struct dirent *de;
-    dir = opendir(dirname);
+    char devname[PATH_MAX];
+
+    releaseInputs();
+    sNumInputDevices = 0;
+
+    dir = opendir(INPUT_DIR);
     if (dir == NULL)
-        return -1;
-    strcpy(devname, dirname);
-    filename = devname + strlen(devname);
-    *filename++ = '/';
+        return;
     while ((de = readdir(dir))) {
+        input_device *dev = &sInputDevices[sNumInputDevices];
+        int fd;
+
         if (de->d_name[0] == '.' &&
                 (de->d_name[1] == '\0' ||
                         (de->d_name[1] == '.' && de->d_name[2] == '\0')))
             continue;
-        strcpy(filename, de->d_name);
+        if (sNumInputDevices == MAX_INPUT_DEVICES) {
+            ALOGW("more than %d input devices, ignoring the others",
+                  MAX_INPUT_DEVICES);
+            break;
+        }
+        snprintf(devname, sizeof(devname), INPUT_DIR "/%s", de->d_name);
         fd = open(devname, O_RDONLY);
-        if (fd >= 0) {
-            char name[80];
-            if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1) {
-                name[0] = '\0';
-            }
-            if (!strcmp(name, inputName)) {
-                strcpy(input_name, filename);
-                break;
-            } else {
-                close(fd);
-                fd = -1;
-            }
+        if (fd < 0)
+            continue;
+        if (ioctl(fd, EVIOCGNAME(sizeof(dev->name) - 1), dev->name) < 1) {
+            dev->name[0] = '\0';
         }
+        strlcpy(dev->node, de->d_name, sizeof(dev->node));
+        dev->fd = fd;
+        sNumInputDevices++;
     }
     closedir(dir);
+}
+
+void SensorBase::releaseInputs() {
+    for (int i = 0; i < sNumInputDevices; i++) {
+        if (sInputDevices[i].fd >= 0) {
+            close(sInputDevices[i].fd);
+            sInputDevices[i].fd = -1;
+        }
+    }
+    sNumInputDevices = -1;
+}
+
+int SensorBase::openInput(const char* inputName) {
+    int fd = -1;
+
+    if (sNumInputDevices < 0)
+        scanInputs();
+
+    for (int i = 0; i < sNumInputDevices; i++) {
+        input_device *dev = &sInputDevices[i];
+
+        if (strcmp(dev->name, inputName))
+            continue;
+        strcpy(input_name, dev->node);
+        if (dev->fd >= 0) {
+            fd = dev->fd;
+            dev->fd = -1;
+        } else {
+            /* claimed by another driver already, open a second fd */
+            char devname[PATH_MAX];
+            snprintf(devname, sizeof(devname), INPUT_DIR "/%s", dev->node);
+            fd = open(devname, O_RDONLY);
+        }
+        break;
+    }
     ALOGE_IF(fd < 0, "couldn't find '%s' input device", inputName);
     return fd;
 }
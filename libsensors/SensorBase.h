@@ -38,6 +38,11 @@ protected:
 public:
     SensorBase(const char* data_name);
 
+    /* index the input devices once, so that the drivers constructed before
+     * releaseInputs() claim their fd without scanning /dev/input again */
+    static void scanInputs();
+    static void releaseInputs();
+
     virtual ~SensorBase();
 
     virtual int readEvents(sensors_event_t* data, int count) = 0;
@@ -45,6 +50,11 @@ public:
     virtual int getFd() const;
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int enable(int32_t handle, int enabled) = 0;
+    /* drivers without an event queue only honor the sampling period */
+    virtual int batch(int32_t handle, int flags, int64_t period_ns, int64_t timeout);
+    /* returns -ENOSYS if the driver has no queued events to flush, in which
+     * case the flush complete event is reported by the poll context */
+    virtual int flush(int32_t handle);
 };
 
 /*****************************************************************************/
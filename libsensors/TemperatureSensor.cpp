@@ -29,7 +29,7 @@
 #define TEMPERATURE_CELCIUS (1.0f/10.0f)
 
 TemperatureSensor::TemperatureSensor()
-    : SamsungSensorBase("barometer", ABS_MISC)
+    : SamsungSensorBase("barometer", ABS_MISC, 20000000)
 {
     mPendingEvent.sensor = ID_T;
     mPendingEvent.type = SENSOR_TYPE_AMBIENT_TEMPERATURE;
@@ -23,6 +23,27 @@ LOCAL_SHARED_LIBRARIES := liblog libm libutils libcutils
 include $(BUILD_SHARED_LIBRARY)
 
 
+MLLITE_SRC_FILES := \
+	mlsdk/mllite/accel.c \
+	mlsdk/mllite/compass.c \
+	mlsdk/mllite/mldl_cfg_mpu.c \
+	mlsdk/mllite/dmpDefault.c \
+	mlsdk/mllite/ml.c \
+	mlsdk/mllite/mlarray.c \
+	mlsdk/mllite/mlFIFO.c \
+	mlsdk/mllite/mlFIFOHW.c \
+	mlsdk/mllite/mlMathFunc.c \
+	mlsdk/mllite/ml_stored_data.c \
+	mlsdk/mllite/mlcontrol.c \
+	mlsdk/mllite/mldl.c \
+	mlsdk/mllite/mldmp.c \
+	mlsdk/mllite/mlstates.c \
+	mlsdk/mllite/mlsupervisor.c \
+	mlsdk/mllite/mlBiasNoMotion.c \
+	mlsdk/mllite/mlSetGyroBias.c \
+	mlsdk/mllite/mlcompat.c \
+	mlsdk/mlutils/checksum.c
+
 include $(CLEAR_VARS)
 LOCAL_MODULE := libmllite
 LOCAL_MODULE_TAGS := optional
@@ -45,26 +66,43 @@ LOCAL_C_INCLUDES := \
 	$(MLSDK_PATH)/platform/include/linux \
 	$(MLSDK_PATH)/platform/linux
 
-LOCAL_SRC_FILES := \
-	mlsdk/mllite/accel.c \
-	mlsdk/mllite/compass.c \
-	mlsdk/mllite/mldl_cfg_mpu.c \
-	mlsdk/mllite/dmpDefault.c \
-	mlsdk/mllite/ml.c \
-	mlsdk/mllite/mlarray.c \
-	mlsdk/mllite/mlFIFO.c \
-	mlsdk/mllite/mlFIFOHW.c \
-	mlsdk/mllite/mlMathFunc.c \
-	mlsdk/mllite/ml_stored_data.c \
-	mlsdk/mllite/mlcontrol.c \
-	mlsdk/mllite/mldl.c \
-	mlsdk/mllite/mldmp.c \
-	mlsdk/mllite/mlstates.c \
-	mlsdk/mllite/mlsupervisor.c \
-	mlsdk/mllite/mlBiasNoMotion.c \
-	mlsdk/mllite/mlSetGyroBias.c \
-	mlsdk/mllite/mlcompat.c \
-	mlsdk/mlutils/checksum.c \
+LOCAL_SRC_FILES := $(MLLITE_SRC_FILES)
 
 LOCAL_SHARED_LIBRARIES := libm libutils libcutils liblog libmlplatform
 include $(BUILD_SHARED_LIBRARY)
+
+
+# host benchmark of the per sample mllite code, on an emulated MPU. Prints
+# ns/op and the error of each kernel against a double reference, and exits
+# non zero if one is out of tolerance.
+include $(CLEAR_VARS)
+LOCAL_MODULE := mlbench
+LOCAL_MODULE_TAGS := optional
+# the MPL assumes a 32 bits long, as on the device
+LOCAL_MULTILIB := 32
+
+LOCAL_CFLAGS := -DNDEBUG -D_REENTRANT -DLINUX -DANDROID
+LOCAL_CFLAGS += -DUNICODE -D_UNICODE -DSK_RELEASE
+LOCAL_CFLAGS += -Wall -Werror
+
+LOCAL_C_INCLUDES := \
+	$(MLSDK_PATH)/mllite \
+	$(MLSDK_PATH)/mlutils \
+	$(MLSDK_PATH)/platform/include \
+	$(MLSDK_PATH)/platform/include/linux \
+	$(MLSDK_PATH)/platform/linux \
+	$(MLSDK_PATH)/..
+
+LOCAL_SRC_FILES := $(MLLITE_SRC_FILES) \
+	mlsdk/mlbench/mlbench.c \
+	mlsdk/mlbench/mlbench_platform.c \
+	mlsdk/mlbench/mlbench_fusion.cpp \
+	mlsdk/mlbench/mlbench_clock.cpp \
+	HostFusion.cpp \
+	SampleClock.cpp
+
+# the /dev/mpu ioctls of mldl_cfg_mpu.c go to the emulated driver
+LOCAL_LDFLAGS := -Wl,--wrap=ioctl
+LOCAL_LDLIBS := -lm -lpthread -lrt
+LOCAL_STATIC_LIBRARIES := liblog
+include $(BUILD_HOST_EXECUTABLE)
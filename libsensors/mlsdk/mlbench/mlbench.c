@@ -0,0 +1,1583 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Micro-benchmarks of the per sample mllite code: the fixed point math, the
+ * compass filter, the float getters and the accel/compass supervisor. Each
+ * one reports ns/op and the largest error against a double precision
+ * reference computed from the same input; the exit status is the number of
+ * references not matched.
+ *
+ * The MPL is opened on the emulated MPU of mlbench_platform.c, and fed with
+ * the FIFO packets of a simulated device rotating in the earth field.
+ * The HostFusion and SampleClock of the HAL are checked the same way, on the
+ * simulated packets and on the interrupts of a drifting FIFO clock.
+ *
+ *   mlbench -t trace [-o outputs] [-c reference]
+ *
+ * replays instead a trace recorded on the device with debug.mpl.trace: every
+ * interrupt goes through inv_update_data() and the outputs the MPLSensor
+ * handlers read, and the cost per FIFO packet is reported. The outputs can be
+ * written, and compared with the ones of an earlier run. HostFusion is
+ * compared with the recorded DMP quaternion, and the recorded interrupts are
+ * fit by SampleClock.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compass.h"
+#include "ml.h"
+#include "mldl.h"
+#include "mldmp.h"
+#include "mlFIFO.h"
+#include "mlMathFunc.h"
+#include "mlos.h"
+#include "ml_stored_data.h"
+#include "mlsl.h"
+#include "mlsupervisor.h"
+#include "mpu3050.h"
+
+#include "mlbench.h"
+
+#define Q16         (65536.0)
+#define Q29         (536870912.0)
+#define Q30         (1073741824.0)
+
+/* best of RUNS runs, each one long enough for the clock resolution */
+#define RUNS        (15)
+#define NUM_INPUTS  (1024)
+#define NUM_LOOPS   (200000)
+
+/* FIFO packet sent by the DMP for inv_send_quaternion(),
+   inv_send_gyro() and inv_send_accel() in 32 bits, plus the footer */
+#define PACKET_SIZE (16 + 12 + 12 + 2)
+
+/* simulated device */
+#define STEP_MS             (25)
+#define SIM_STEPS           (8000)
+#define CHECK_STEPS         (400)
+#define REPLAY_STEPS        (2000)
+/* time HostFusion is given to converge before it is compared */
+#define FUSION_SETTLE_S     (10.0)
+
+static const double earth_field_ut[3] = { 0, 22.0, -41.0 };
+static const double hard_iron_ut[3] = { 31.0, -12.5, 54.0 };
+
+struct sample {
+    unsigned char packet[PACKET_SIZE];
+    short compass[3];
+    double quat[4];
+    double gyro_dps[3];
+    double accel_g[3];
+    double linear_accel_g[3];
+    double field_ut[3];         /* body frame, without the hard iron */
+};
+
+static int failures;
+static volatile long sink;
+static volatile float fsink;
+
+static long qa[NUM_INPUTS][4], qb[NUM_INPUTS][4];
+static float mats[NUM_INPUTS / 16][10 * 10];
+static struct sample samples[NUM_INPUTS];
+static struct sample trajectory[SIM_STEPS + CHECK_STEPS];
+
+/* ------------------------------------------------------------------------ */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ns per iteration of fn(n), best of RUNS */
+static double time_loop(void (*fn)(int n), int n)
+{
+    double best = 0;
+    int run;
+
+    for (run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        double ns;
+
+        fn(n);
+        ns = (now_ns() - start) / n;
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+/* ns per iteration of fn(n) minus the one of base(n), each the best of RUNS
+   alternated runs so that both see the same state of the machine */
+static double time_loop_over(void (*fn)(int n), void (*base)(int n), int n)
+{
+    double best = 0, best_base = 0;
+    int run;
+
+    for (run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        double ns;
+
+        base(n);
+        ns = (now_ns() - start) / n;
+        if (run == 0 || ns < best_base)
+            best_base = ns;
+
+        start = now_ns();
+        fn(n);
+        ns = (now_ns() - start) / n;
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+    return best - best_base;
+}
+
+/* a NAN ns reports only the check, a NULL unit only the time */
+static void report(const char *name, double ns, double err, double tol,
+                   const char *unit)
+{
+    int ok = err <= tol;
+
+    if (!isnan(ns))
+        printf("%-36s %8.1f ns/op", name, ns);
+    else
+        printf("%-36s %14s", name, "");
+    if (unit)
+        printf("   max err %10.3g %-5s (tol %.3g)  %s", err, unit, tol,
+               ok ? "ok" : "FAIL");
+    printf("\n");
+    if (unit && !ok)
+        failures++;
+}
+
+static void check(const char *what, inv_error_t result)
+{
+    if (result != INV_SUCCESS) {
+        fprintf(stderr, "%s failed: %d\n", what, result);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* uniform in [-1, 1), the same sequence on every run */
+static double frand(void)
+{
+    static unsigned long long state = 0x2545f4914f6cdd1dULL;
+
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double)(state >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+static void random_quat(double *q)
+{
+    double norm = 0;
+    int ii;
+
+    for (ii = 0; ii < 4; ii++) {
+        q[ii] = frand();
+        norm += q[ii] * q[ii];
+    }
+    norm = sqrt(norm);
+    for (ii = 0; ii < 4; ii++)
+        q[ii] /= norm;
+}
+
+static long to_fixed(double x, double one)
+{
+    return (long)lrint(x * one);
+}
+
+/* ------------------------------------------------------------------------ */
+/* fixed point math                                                         */
+
+static void loop_q29_mult(int n)
+{
+    long acc = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        acc += inv_q29_mult(qa[i % NUM_INPUTS][i & 3],
+                            qb[i % NUM_INPUTS][i & 3]);
+    sink = acc;
+}
+
+static void loop_q_mult(int n)
+{
+    long prod[4];
+    int i;
+
+    for (i = 0; i < n; i++)
+        inv_q_mult(qa[i % NUM_INPUTS], qb[i % NUM_INPUTS], prod);
+    sink = prod[0];
+}
+
+static void loop_quaternion_to_rotation(int n)
+{
+    long rot[9];
+    int i;
+
+    for (i = 0; i < n; i++)
+        inv_quaternion_to_rotation(qa[i % NUM_INPUTS], rot);
+    sink = rot[0];
+}
+
+static int det_size;
+
+static void loop_matrix_det(int n)
+{
+    float acc = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        int size = det_size;
+        acc += inv_matrix_det(mats[i % (NUM_INPUTS / 16)], &size);
+    }
+    fsink = acc;
+}
+
+/* determinant by a partial pivoting LU in double */
+static double det_reference(const float *p, int n)
+{
+    double a[10][10];
+    double det = 1;
+    int i, j, k;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++)
+            a[i][j] = p[10 * i + j];
+    for (k = 0; k < n; k++) {
+        int pivot = k;
+        for (i = k + 1; i < n; i++)
+            if (fabs(a[i][k]) > fabs(a[pivot][k]))
+                pivot = i;
+        if (pivot != k) {
+            for (j = 0; j < n; j++) {
+                double t = a[k][j];
+                a[k][j] = a[pivot][j];
+                a[pivot][j] = t;
+            }
+            det = -det;
+        }
+        det *= a[k][k];
+        for (i = k + 1; i < n; i++) {
+            double f = a[i][k] / a[k][k];
+            for (j = k + 1; j < n; j++)
+                a[i][j] -= f * a[k][j];
+        }
+    }
+    return det;
+}
+
+static void bench_math(void)
+{
+    double err;
+    int i, j;
+
+    for (i = 0; i < NUM_INPUTS; i++) {
+        double q[4];
+
+        random_quat(q);
+        for (j = 0; j < 4; j++)
+            qa[i][j] = to_fixed(q[j], Q30);
+        random_quat(q);
+        for (j = 0; j < 4; j++)
+            qb[i][j] = to_fixed(q[j], Q30);
+    }
+
+    /* a full 32 bits product is floored by the shift: under 1 LSB */
+    err = 0;
+    for (i = 0; i < NUM_INPUTS; i++) {
+        for (j = 0; j < 4; j++) {
+            double ref = (double)qa[i][j] * qb[i][j] / Q29;
+            err = fmax(err, fabs(inv_q29_mult(qa[i][j], qb[i][j]) - ref));
+        }
+    }
+    report("inv_q29_mult", time_loop(loop_q29_mult, NUM_LOOPS * 10), err,
+           1, "lsb");
+
+    err = 0;
+    for (i = 0; i < NUM_INPUTS; i++) {
+        const long *a = qa[i], *b = qb[i];
+        double ref[4];
+        long prod[4];
+
+        ref[0] = (double)a[0] * b[0] - (double)a[1] * b[1] -
+            (double)a[2] * b[2] - (double)a[3] * b[3];
+        ref[1] = (double)a[0] * b[1] + (double)a[1] * b[0] +
+            (double)a[2] * b[3] - (double)a[3] * b[2];
+        ref[2] = (double)a[0] * b[2] - (double)a[1] * b[3] +
+            (double)a[2] * b[0] + (double)a[3] * b[1];
+        ref[3] = (double)a[0] * b[3] + (double)a[1] * b[2] -
+            (double)a[2] * b[1] + (double)a[3] * b[0];
+        inv_q_mult(a, b, prod);
+        for (j = 0; j < 4; j++)
+            err = fmax(err, fabs(prod[j] - ref[j] / Q30));
+    }
+    report("inv_q_mult", time_loop(loop_q_mult, NUM_LOOPS), err, 1, "lsb");
+
+    /* two floored products per element */
+    err = 0;
+    for (i = 0; i < NUM_INPUTS; i++) {
+        double q[4], ref[9];
+        long rot[9];
+
+        for (j = 0; j < 4; j++)
+            q[j] = qa[i][j] / Q30;
+        ref[0] = 2 * (q[0] * q[0] + q[1] * q[1]) - 1;
+        ref[1] = 2 * (q[1] * q[2] - q[0] * q[3]);
+        ref[2] = 2 * (q[1] * q[3] + q[0] * q[2]);
+        ref[3] = 2 * (q[1] * q[2] + q[0] * q[3]);
+        ref[4] = 2 * (q[0] * q[0] + q[2] * q[2]) - 1;
+        ref[5] = 2 * (q[2] * q[3] - q[0] * q[1]);
+        ref[6] = 2 * (q[1] * q[3] - q[0] * q[2]);
+        ref[7] = 2 * (q[2] * q[3] + q[0] * q[1]);
+        ref[8] = 2 * (q[0] * q[0] + q[3] * q[3]) - 1;
+        inv_quaternion_to_rotation(qa[i], rot);
+        for (j = 0; j < 9; j++)
+            err = fmax(err, fabs(rot[j] - ref[j] * Q30));
+    }
+    report("inv_quaternion_to_rotation",
+           time_loop(loop_quaternion_to_rotation, NUM_LOOPS), err, 2, "lsb");
+
+    /* covariance like matrices, as the compass and bias fits build them */
+    for (i = 0; i < NUM_INPUTS / 16; i++) {
+        for (j = 0; j < 100; j++)
+            mats[i][j] = (float)frand();
+        for (j = 0; j < 10; j++)
+            mats[i][11 * j] += 4.0f;
+    }
+    for (det_size = 3; det_size <= 6; det_size += det_size == 4 ? 2 : 1) {
+        char name[40];
+
+        err = 0;
+        for (i = 0; i < NUM_INPUTS / 16; i++) {
+            double ref = det_reference(mats[i], det_size);
+            int size = det_size;
+            err = fmax(err, fabs(inv_matrix_det(mats[i], &size) - ref) /
+                       fabs(ref));
+        }
+        snprintf(name, sizeof(name), "inv_matrix_det %dx%d", det_size,
+                 det_size);
+        report(name, time_loop(loop_matrix_det, NUM_LOOPS / 4), err, 1e-5,
+               "rel");
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* simulated device                                                         */
+
+/* ------------------------------------------------------------------------ */
+/* compass filter                                                           */
+
+#define FILTER_SAMPLES      (60000)
+/* samples between two changes of the input noise */
+#define FILTER_RUN          (150)
+
+static float filter_in[FILTER_SAMPLES][3];
+static float filter_out[FILTER_SAMPLES][3];
+static yas_filter_if_s filter_if;
+static yas_filter_handle_t filter_handle;
+
+/* the adaptive filter as it was, with a qsort() of the window per sample */
+static struct {
+    struct yas_adaptive_filter adap_filter[3];
+    struct yas_thresh_filter thresh_filter[3];
+} qsort_handle;
+
+static int cmpfloat(const void *p1, const void *p2)
+{
+    return *(float*)p1 - *(float*)p2;
+}
+
+static float qsort_filter(struct yas_adaptive_filter *adap_filter, float in)
+{
+    float avg, sum, median, sorted[YAS_DEFAULT_FILTER_LEN];
+    int i;
+    int len = adap_filter->len;
+
+    if (adap_filter->num < len) {
+        adap_filter->sequence[adap_filter->index++] = in;
+        adap_filter->num++;
+        return in;
+    }
+    if (len <= adap_filter->index)
+        adap_filter->index = 0;
+    adap_filter->sequence[adap_filter->index++] = in;
+
+    avg = 0;
+    for (i = 0; i < len; i++)
+        avg += adap_filter->sequence[i];
+    avg /= len;
+
+    memcpy(sorted, adap_filter->sequence, len * sizeof(float));
+    qsort(&sorted, len, sizeof(float), cmpfloat);
+    median = sorted[len/2];
+
+    sum = 0;
+    for (i = 0; i < len; i++)
+        sum += powf(avg - adap_filter->sequence[i], 2);
+    sum /= len;
+
+    if (sum <= adap_filter->noise)
+        return median;
+    return ((in - avg) * (sum - adap_filter->noise) / sum + avg);
+}
+
+static float thresh_filter(struct yas_thresh_filter *thresh_filter, float in)
+{
+    if (in < thresh_filter->last - thresh_filter->threshold ||
+            thresh_filter->last + thresh_filter->threshold < in)
+        thresh_filter->last = in;
+    return thresh_filter->last;
+}
+
+static void loop_yas_filter(int n)
+{
+    int i;
+
+    filter_if.init(&filter_handle);
+    for (i = 0; i < n; i++)
+        filter_if.update(&filter_handle, filter_in[i], filter_out[i]);
+}
+
+static void loop_qsort_filter(int n)
+{
+    int i, ii;
+
+    filter_if.init((yas_filter_handle_t *)&qsort_handle);
+    for (i = 0; i < n; i++)
+        for (ii = 0; ii < 3; ii++)
+            filter_out[i][ii] = thresh_filter(
+                &qsort_handle.thresh_filter[ii],
+                qsort_filter(&qsort_handle.adap_filter[ii], filter_in[i][ii]));
+}
+
+static int cmpdouble(const void *p1, const void *p2)
+{
+    double a = *(const double *)p1, b = *(const double *)p2;
+
+    return a < b ? -1 : a > b;
+}
+
+/*
+ * Runs of compass samples in nT around an earth field of 40000 nT: quiet
+ * runs under the 2000 nT noise of the filter, with many equal samples and
+ * samples less than 1 nT apart, and noisy runs above it.
+ */
+static void filter_inputs(void)
+{
+    double sigma = 0, step = 1;
+    int i, ii;
+
+    for (i = 0; i < FILTER_SAMPLES; i++) {
+        if (i % FILTER_RUN == 0) {
+            switch ((int)((1 + frand()) * 2)) {
+            case 0:
+                sigma = 3;
+                step = 1;
+                break;
+            case 1:
+                sigma = 400;
+                step = 0.25;
+                break;
+            case 2:
+                sigma = 1500;
+                step = 1.0 / 64;
+                break;
+            default:
+                sigma = 6000;
+                step = 0.5;
+                break;
+            }
+        }
+        for (ii = 0; ii < 3; ii++) {
+            double x = 40000 * (ii - 1) + sigma * (frand() + frand() + frand());
+
+            filter_in[i][ii] = (float)(floor(x / step) * step);
+        }
+    }
+}
+
+static void bench_compass_filter(void)
+{
+    double window[YAS_DEFAULT_FILTER_LEN], sorted[YAS_DEFAULT_FILTER_LEN];
+    double mean_err = 0, var_err = 0, out_err = 0, ns;
+    float last[3] = { 0, 0, 0 };
+    int median_err = 0;
+    int i, ii, j;
+
+    filter_inputs();
+    yas_filter_init(&filter_if);
+
+    report("qsort + powf filter (before)",
+           time_loop(loop_qsort_filter, FILTER_SAMPLES), 0, 0, NULL);
+    ns = time_loop(loop_yas_filter, FILTER_SAMPLES);
+
+    /* the window statistics in double from a sort of the window, against
+       the state left by the filter, and the output they give through the
+       threshold filter, whose state is the previous output */
+    filter_if.init(&filter_handle);
+    for (i = 0; i < FILTER_SAMPLES; i++) {
+        float out[3];
+
+        filter_if.update(&filter_handle, filter_in[i], out);
+        for (ii = 0; ii < 3; ii++) {
+            struct yas_adaptive_filter *f = &filter_handle.adap_filter[ii];
+            int len = f->len;
+            double mean = 0, var = 0, median, ref, step;
+
+            if (i < len) {
+                /* the window is filling, the sample is given out as is */
+                ref = filter_in[i][ii];
+            } else {
+                for (j = 0; j < len; j++) {
+                    window[j] = filter_in[i - len + 1 + j][ii];
+                    mean += window[j];
+                }
+                mean /= len;
+                for (j = 0; j < len; j++)
+                    var += (window[j] - mean) * (window[j] - mean);
+                var /= len;
+                memcpy(sorted, window, len * sizeof(sorted[0]));
+                qsort(sorted, len, sizeof(sorted[0]), cmpdouble);
+                median = sorted[len / 2];
+
+                if (f->sorted[len / 2] != median)
+                    median_err++;
+                mean_err = fmax(mean_err, fabs(f->sum / len - mean));
+                var_err = fmax(var_err,
+                               fabs(f->sum_sq / len - (f->sum / len) *
+                                    (f->sum / len) - var) / f->noise);
+                if (var <= f->noise)
+                    ref = median;
+                else
+                    ref = (filter_in[i][ii] - mean) * (var - f->noise) / var +
+                        mean;
+            }
+
+            step = fabs(ref - last[ii]);
+            /* the float result may fall on either side of the threshold */
+            if (fabs(step - YAS_DEFAULT_FILTER_THRESH) < 1e-2)
+                ref = out[ii];
+            else if (step <= YAS_DEFAULT_FILTER_THRESH)
+                ref = last[ii];
+            out_err = fmax(out_err, fabs(out[ii] - ref));
+            last[ii] = out[ii];
+        }
+    }
+
+    report("yas_filter update", ns, median_err, 0, "");
+    report("yas adaptive filter mean", NAN, mean_err, 1e-6, "nT");
+    report("yas adaptive filter variance", NAN, var_err, 1e-6, "noise");
+    /* a float is within 0.008 nT at 80000 nT */
+    report("yas_filter output", NAN, out_err, 0.01, "nT");
+}
+
+static void put_be32(unsigned char *p, long x)
+{
+    p[0] = (unsigned char)((x >> 24) & 0xff);
+    p[1] = (unsigned char)((x >> 16) & 0xff);
+    p[2] = (unsigned char)((x >> 8) & 0xff);
+    p[3] = (unsigned char)(x & 0xff);
+}
+
+/* rotation from body to world of a unit quaternion, by rows */
+static void rotation(const double *q, double *r)
+{
+    r[0] = 2 * (q[0] * q[0] + q[1] * q[1]) - 1;
+    r[1] = 2 * (q[1] * q[2] - q[0] * q[3]);
+    r[2] = 2 * (q[1] * q[3] + q[0] * q[2]);
+    r[3] = 2 * (q[1] * q[2] + q[0] * q[3]);
+    r[4] = 2 * (q[0] * q[0] + q[2] * q[2]) - 1;
+    r[5] = 2 * (q[2] * q[3] - q[0] * q[1]);
+    r[6] = 2 * (q[1] * q[3] - q[0] * q[2]);
+    r[7] = 2 * (q[2] * q[3] + q[0] * q[1]);
+    r[8] = 2 * (q[0] * q[0] + q[3] * q[3]) - 1;
+}
+
+/*
+ * Device turning at about 90 dps around a wandering axis, shaken by 0.1 g,
+ * dt_ms after the previous sample. Builds what the DMP and the compass would
+ * send for it.
+ */
+static void simulate(struct sample *s, double t, double dt_ms)
+{
+    static double q[4] = { 1, 0, 0, 0 };
+    double w[3], r[9], dq[4], nq[4], angle, norm;
+    double compass_ut[3];
+    int ii;
+
+    w[0] = 90 * sin(0.9 * t);
+    w[1] = 90 * cos(0.7 * t);
+    w[2] = 90 * sin(0.5 * t + 1);
+
+    /* integrate the body rate */
+    norm = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+    angle = norm * M_PI / 180 * dt_ms / 1000;
+    dq[0] = cos(angle / 2);
+    for (ii = 0; ii < 3; ii++)
+        dq[ii + 1] = norm > 0 ? sin(angle / 2) * w[ii] / norm : 0;
+    nq[0] = q[0] * dq[0] - q[1] * dq[1] - q[2] * dq[2] - q[3] * dq[3];
+    nq[1] = q[0] * dq[1] + q[1] * dq[0] + q[2] * dq[3] - q[3] * dq[2];
+    nq[2] = q[0] * dq[2] - q[1] * dq[3] + q[2] * dq[0] + q[3] * dq[1];
+    nq[3] = q[0] * dq[3] + q[1] * dq[2] - q[2] * dq[1] + q[3] * dq[0];
+    norm = sqrt(nq[0] * nq[0] + nq[1] * nq[1] + nq[2] * nq[2] +
+                nq[3] * nq[3]);
+    for (ii = 0; ii < 4; ii++)
+        q[ii] = nq[ii] / norm;
+    rotation(q, r);
+
+    for (ii = 0; ii < 3; ii++) {
+        s->quat[ii] = q[ii];
+        s->gyro_dps[ii] = w[ii];
+        s->linear_accel_g[ii] = 0.1 * sin(3.0 * t + ii);
+        /* the world z axis and the earth field seen from the body */
+        s->accel_g[ii] = r[6 + ii] + s->linear_accel_g[ii];
+        s->field_ut[ii] = r[ii] * earth_field_ut[0] +
+            r[3 + ii] * earth_field_ut[1] + r[6 + ii] * earth_field_ut[2];
+        compass_ut[ii] = s->field_ut[ii] + hard_iron_ut[ii];
+        s->compass[ii] = (short)lrint(compass_ut[ii] /
+                                      (MLBENCH_COMPASS_RANGE_UT / 32768));
+    }
+    s->quat[3] = q[3];
+
+    memset(s->packet, 0, sizeof(s->packet));
+    for (ii = 0; ii < 4; ii++)
+        put_be32(&s->packet[4 * ii], to_fixed(q[ii], Q30));
+    /* gyro, dps * 2^16 once scaled by the 1501974482 of fifo_scale */
+    for (ii = 0; ii < 3; ii++)
+        put_be32(&s->packet[16 + 4 * ii],
+                 to_fixed(w[ii] * Q16, Q30 / 1501974482.0));
+    /* accel, fraction of the full scale in q30 */
+    for (ii = 0; ii < 3; ii++)
+        put_be32(&s->packet[28 + 4 * ii],
+                 to_fixed(s->accel_g[ii] / MLBENCH_ACCEL_RANGE_G, Q30));
+}
+
+static void replay_packet_cb(void);
+
+/* as MPLSensor::initMPL() and setupFIFO(), so that its traces replay here */
+static void open_mpl(void)
+{
+    check("inv_serial_start", inv_serial_start("/dev/mpu"));
+    check("inv_dmp_open", inv_dmp_open());
+    check("inv_set_mpu_sensors",
+          inv_set_mpu_sensors(INV_THREE_AXIS_ACCEL | INV_THREE_AXIS_COMPASS |
+                              INV_THREE_AXIS_GYRO));
+    check("inv_set_bias_update", inv_set_bias_update(0xFFFF));
+    check("inv_set_motion_interrupt", inv_set_motion_interrupt(1));
+    check("inv_set_fifo_interrupt", inv_set_fifo_interrupt(1));
+    check("inv_set_fifo_rate", inv_set_fifo_rate(6));
+    check("inv_set_fifo_processed_callback",
+          inv_set_fifo_processed_callback(replay_packet_cb));
+    /* quaternion, gyro and accel: the packet built by simulate() */
+    check("inv_send_accel", inv_send_accel(INV_ALL, INV_32_BIT));
+    check("inv_send_quaternion", inv_send_quaternion(INV_32_BIT));
+    check("inv_send_linear_accel",
+          inv_send_linear_accel(INV_ALL, INV_32_BIT));
+    check("inv_send_linear_accel_in_world",
+          inv_send_linear_accel_in_world(INV_ALL, INV_32_BIT));
+    check("inv_send_gravity", inv_send_gravity(INV_ALL, INV_32_BIT));
+    check("inv_send_gyro", inv_send_gyro(INV_ALL, INV_32_BIT));
+    check("inv_dmp_start", inv_dmp_start());
+}
+
+/* ------------------------------------------------------------------------ */
+/* float getters                                                            */
+
+static inv_error_t (*getter)(float *data);
+
+static void loop_packet(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        inv_process_fifo_packet(samples[i % NUM_INPUTS].packet);
+}
+
+static void loop_packet_getter(int n)
+{
+    float data[9];
+    int i;
+
+    for (i = 0; i < n; i++) {
+        inv_process_fifo_packet(samples[i % NUM_INPUTS].packet);
+        getter(data);
+    }
+    fsink = data[0];
+}
+
+/* largest difference of a getter with the reference of each sample */
+static double getter_error(int len, void (*reference)(const struct sample *s,
+                                                      double *ref))
+{
+    double err = 0;
+    int i, j;
+
+    for (i = 0; i < NUM_INPUTS; i++) {
+        float data[9];
+        double ref[9];
+
+        inv_process_fifo_packet(samples[i].packet);
+        check("getter", getter(data));
+        reference(&samples[i], ref);
+        for (j = 0; j < len; j++)
+            err = fmax(err, fabs(data[j] - ref[j]));
+    }
+    return err;
+}
+
+static void ref_gyro(const struct sample *s, double *ref)
+{
+    memcpy(ref, s->gyro_dps, 3 * sizeof(double));
+}
+
+static void ref_accel(const struct sample *s, double *ref)
+{
+    memcpy(ref, s->accel_g, 3 * sizeof(double));
+}
+
+static void ref_quaternion(const struct sample *s, double *ref)
+{
+    memcpy(ref, s->quat, 4 * sizeof(double));
+}
+
+static void ref_rot_mat(const struct sample *s, double *ref)
+{
+    rotation(s->quat, ref);
+}
+
+static void ref_gravity(const struct sample *s, double *ref)
+{
+    double r[9];
+
+    rotation(s->quat, r);
+    memcpy(ref, &r[6], 3 * sizeof(double));
+}
+
+static void ref_linear_accel(const struct sample *s, double *ref)
+{
+    memcpy(ref, s->linear_accel_g, 3 * sizeof(double));
+}
+
+static void bench_getters(void)
+{
+    static const struct {
+        const char *name;
+        inv_error_t (*getter)(float *data);
+        int len;
+        void (*reference)(const struct sample *s, double *ref);
+        double tol;
+        const char *unit;
+    } getters[] = {
+        /* one LSB of the q16 result, plus the rounding of the packet */
+        { "inv_get_gyro_float", inv_get_gyro_float, 3, ref_gyro,
+          2 / Q16, "dps" },
+        { "inv_get_accel_float", inv_get_accel_float, 3, ref_accel,
+          2 / Q16, "g" },
+        { "inv_get_quaternion_float", inv_get_quaternion_float, 4,
+          ref_quaternion, 1e-7, "" },
+        { "inv_get_rot_mat_float", inv_get_rot_mat_float, 9, ref_rot_mat,
+          1e-7, "" },
+        { "inv_get_gravity_float", inv_get_gravity_float, 3, ref_gravity,
+          2 / Q16, "g" },
+        { "inv_get_linear_accel_float", inv_get_linear_accel_float, 3,
+          ref_linear_accel, 4 / Q16, "g" },
+    };
+    unsigned int i;
+
+    for (i = 0; i < NUM_INPUTS; i++)
+        simulate(&samples[i], i * 0.005, 5);
+
+    /* the getters cache per packet, so each call gets a new packet and
+       the cost of the packet alone is subtracted */
+    report("inv_process_fifo_packet", time_loop(loop_packet, NUM_LOOPS), 0, 0,
+           NULL);
+    for (i = 0; i < sizeof(getters) / sizeof(getters[0]); i++) {
+        double err;
+
+        getter = getters[i].getter;
+        err = getter_error(getters[i].len, getters[i].reference);
+        report(getters[i].name,
+               time_loop_over(loop_packet_getter, loop_packet, NUM_LOOPS),
+               err,
+               getters[i].tol, getters[i].unit);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* supervisor                                                               */
+
+static void loop_supervisor_idle(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        inv_accel_compass_supervisor();
+}
+
+/* the calibrated compass sample, as computed by the supervisor */
+static void compass_reference(const struct sample *s, double *ref)
+{
+    double t[3];
+    int i, j;
+
+    for (i = 0; i < 3; i++) {
+        double raw = s->compass[i] * (inv_obj.compass_asa[i] / Q30);
+        t[i] = (raw - inv_obj.init_compass_bias[i]) * inv_obj.compass_sens /
+            16384;
+        t[i] = (t[i] - inv_obj.compass_bias[i]) * inv_obj.compass_scale[i] /
+            65536;
+    }
+    for (i = 0; i < 3; i++) {
+        ref[i] = 0;
+        for (j = 0; j < 3; j++)
+            ref[i] += t[j] * inv_obj.compass_cal[i * 3 + j];
+        ref[i] /= (double)inv_obj.compass_sens * Q16;
+    }
+}
+
+static void bench_supervisor(void)
+{
+    double start, base, ns, err, field_err, bias_err;
+    float data[3];
+    int i, j;
+
+    for (i = 0; i < SIM_STEPS + CHECK_STEPS; i++)
+        simulate(&trajectory[i], i * STEP_MS / 1000.0, STEP_MS);
+
+    /* as in inv_read_and_process_fifo(), one call per packet, at the
+       rate the compass is polled */
+    start = now_ns();
+    for (i = 0; i < SIM_STEPS; i++) {
+        mlbench_advance_ms(STEP_MS);
+        inv_process_fifo_packet(trajectory[i].packet);
+        mlbench_set_compass(trajectory[i].compass);
+    }
+    base = (now_ns() - start) / SIM_STEPS;
+    start = now_ns();
+    for (i = 0; i < SIM_STEPS; i++) {
+        mlbench_advance_ms(STEP_MS);
+        inv_process_fifo_packet(trajectory[i].packet);
+        mlbench_set_compass(trajectory[i].compass);
+        check("inv_accel_compass_supervisor",
+              inv_accel_compass_supervisor());
+    }
+    ns = (now_ns() - start) / SIM_STEPS - base;
+
+    err = 0;
+    field_err = 0;
+    for (i = SIM_STEPS; i < SIM_STEPS + CHECK_STEPS; i++) {
+        double ref[3];
+
+        mlbench_advance_ms(STEP_MS);
+        inv_process_fifo_packet(trajectory[i].packet);
+        mlbench_set_compass(trajectory[i].compass);
+        /* before the call, which may update the calibration after
+           scaling the sample */
+        compass_reference(&trajectory[i], ref);
+        check("inv_accel_compass_supervisor",
+              inv_accel_compass_supervisor());
+        check("inv_get_magnetometer_float", inv_get_magnetometer_float(data));
+        for (j = 0; j < 3; j++) {
+            err = fmax(err, fabs(data[j] - ref[j]));
+            field_err = fmax(field_err,
+                             fabs(data[j] - trajectory[i].field_ut[j]));
+        }
+    }
+    /* integer divisions of the scaling, one LSB of the q16 result each */
+    report("inv_accel_compass_supervisor poll", ns, err, 4 / Q16, "uT");
+
+    /* between two polls, only the clock is checked */
+    report("inv_accel_compass_supervisor idle",
+           time_loop(loop_supervisor_idle, NUM_LOOPS), 0, 0, NULL);
+
+    /* the hard iron found by the sphere fit of MLSensorFusionSupervisor(),
+       within the compass resolution */
+    bias_err = 0;
+    check("inv_get_magnetometer_bias_float",
+          inv_get_magnetometer_bias_float(data));
+    for (j = 0; j < 3; j++)
+        bias_err = fmax(bias_err, fabs(data[j] - hard_iron_ut[j]));
+    if (!inv_obj.got_compass_bias)
+        bias_err = INFINITY;
+    report("MLSensorFusionSupervisor hard iron", NAN, bias_err,
+           MLBENCH_COMPASS_RANGE_UT / 32768, "uT");
+    report("inv_get_magnetometer_float field", NAN, field_err,
+           MLBENCH_COMPASS_RANGE_UT / 32768, "uT");
+}
+
+static void loop_store_calibration(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        sink += inv_store_calibration();
+}
+
+/* the calibration file is only written again when a bias moved by more than
+   its tolerance */
+static void bench_store_calibration(void)
+{
+    static const struct {
+        long accel_bias_step;
+        int written;
+    } steps[] = {
+        { 0, 1 },       /* nothing stored yet */
+        { 0, 0 },
+        { 200, 0 },     /* 3 mg */
+        { 200, 1 },     /* 6 mg from the stored one */
+        { -400, 1 },
+        { 0, 0 },
+    };
+    unsigned int i;
+    int writes, wrong = 0;
+    double ns;
+
+    for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        writes = mlbench_cal_writes();
+        inv_obj.accel_bias[0] += steps[i].accel_bias_step;
+        check("inv_store_calibration", inv_store_calibration());
+        if (mlbench_cal_writes() - writes != steps[i].written)
+            wrong++;
+    }
+
+    writes = mlbench_cal_writes();
+    ns = time_loop(loop_store_calibration, NUM_LOOPS);
+    wrong += mlbench_cal_writes() - writes;
+    report("inv_store_calibration unchanged", ns, wrong, 0, "");
+}
+
+/* ------------------------------------------------------------------------ */
+/* trace replay                                                             */
+
+/* the outputs read by the MPLSensor handlers, in the units of the MPL */
+static const struct {
+    const char *name;
+    int offset;
+    int len;
+    const char *unit;
+} outputs[] = {
+    { "gyro", 0, 3, "dps" },
+    { "accel", 3, 3, "g" },
+    { "magnetic", 6, 3, "uT" },
+    { "quaternion", 9, 4, "" },
+    { "linear_accel", 13, 3, "g" },
+    { "gravity", 16, 3, "g" },
+};
+#define OUTPUT_LEN  (19)
+
+struct replay_output {
+    unsigned long long irqtime;
+    float v[OUTPUT_LEN];
+};
+
+static struct {
+    int active;
+    unsigned long long irqtime;
+    struct replay_output *out;
+    int num;
+    int alloc;
+    int errors;
+} replayed;
+
+static void get_output(inv_error_t (*get)(float *data), float *v, int len)
+{
+    int ii;
+
+    if (get(v) != INV_SUCCESS)
+        for (ii = 0; ii < len; ii++)
+            v[ii] = NAN;
+}
+
+/* called by inv_update_data() for every FIFO packet, where
+   MPLSensor::cbProcData() runs the handlers */
+static void replay_packet_cb(void)
+{
+    struct replay_output *o;
+    long q[4], g[3];
+    int ii;
+
+    if (!replayed.active)
+        return;
+    if (replayed.num == replayed.alloc) {
+        int alloc = replayed.alloc ? 2 * replayed.alloc : 4096;
+        o = realloc(replayed.out, alloc * sizeof(*o));
+        if (!o) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        replayed.out = o;
+        replayed.alloc = alloc;
+    }
+    o = &replayed.out[replayed.num++];
+    o->irqtime = replayed.irqtime;
+
+    get_output(inv_get_gyro_float, &o->v[0], 3);
+    get_output(inv_get_accel_float, &o->v[3], 3);
+    get_output(inv_get_magnetometer_float, &o->v[6], 3);
+    /* as rvHandler() and gravHandler(), from the fixed point outputs */
+    if (inv_get_quaternion(q) == INV_SUCCESS)
+        for (ii = 0; ii < 4; ii++)
+            o->v[9 + ii] = q[ii] / 1073741824.0f;
+    else
+        for (ii = 0; ii < 4; ii++)
+            o->v[9 + ii] = NAN;
+    get_output(inv_get_linear_accel_float, &o->v[13], 3);
+    if (inv_get_gravity(g) == INV_SUCCESS)
+        for (ii = 0; ii < 3; ii++)
+            o->v[16 + ii] = g[ii] / 65536.0f;
+    else
+        for (ii = 0; ii < 3; ii++)
+            o->v[16 + ii] = NAN;
+}
+
+/*
+ * Run inv_update_data() on every interrupt of a trace, as
+ * MPLSensor::readEvents() does, and keep the outputs of each FIFO packet.
+ * Returns the ns per FIFO packet. The configuration changes of the recorded
+ * session are not replayed, the MPL stays as open_mpl() left it.
+ */
+static double replay_trace(FILE *trace)
+{
+    unsigned long long irqtime;
+    double ns = 0;
+
+    if (mlbench_replay_open(trace) < 0) {
+        fprintf(stderr, "cannot read the trace\n");
+        exit(EXIT_FAILURE);
+    }
+    replayed.num = 0;
+    replayed.errors = 0;
+    replayed.active = 1;
+    while (mlbench_replay_next(&irqtime)) {
+        double start = now_ns();
+
+        replayed.irqtime = irqtime;
+        if (inv_update_data() != INV_SUCCESS)
+            replayed.errors++;
+        ns += now_ns() - start;
+    }
+    replayed.active = 0;
+    mlbench_replay_close();
+    return replayed.num ? ns / replayed.num : NAN;
+}
+
+static void write_outputs(FILE *fp)
+{
+    int i, j;
+
+    for (i = 0; i < replayed.num; i++) {
+        fprintf(fp, "%llu", replayed.out[i].irqtime);
+        for (j = 0; j < OUTPUT_LEN; j++)
+            fprintf(fp, " %.9g", replayed.out[i].v[j]);
+        fprintf(fp, "\n");
+    }
+}
+
+static double output_diff(float a, double b)
+{
+    if (isnan(a) || isnan(b))
+        return isnan(a) && isnan(b) ? 0 : INFINITY;
+    return fabs(a - b);
+}
+
+/* the largest difference of each output with the ones written by an earlier
+   run, any difference is reported as a failure */
+static void compare_outputs(FILE *fp)
+{
+    double diff[sizeof(outputs) / sizeof(outputs[0])] = { 0 };
+    char line[1024];
+    unsigned int k;
+    int i = 0, j;
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line, *end;
+        double ref;
+
+        (void)strtoull(p, &end, 10);
+        if (i < replayed.num) {
+            for (k = 0; k < sizeof(outputs) / sizeof(outputs[0]); k++) {
+                for (j = 0; j < outputs[k].len; j++) {
+                    p = end;
+                    ref = strtod(p, &end);
+                    /* %.9g gives back the same float */
+                    ref = end == p ? INFINITY : (float)ref;
+                    diff[k] = fmax(diff[k], output_diff(
+                        replayed.out[i].v[outputs[k].offset + j], ref));
+                }
+            }
+        }
+        i++;
+    }
+
+    report("FIFO packets", NAN, abs(i - replayed.num), 0, "");
+    for (k = 0; k < sizeof(outputs) / sizeof(outputs[0]); k++)
+        report(outputs[k].name, NAN, diff[k], 0, outputs[k].unit);
+}
+
+static void trace_record(FILE *fp, unsigned long long timestamp,
+                         unsigned char type, unsigned short address,
+                         unsigned short length, const void *data)
+{
+    struct mlsl_trace_record rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.timestamp = timestamp;
+    rec.result = INV_SUCCESS;
+    rec.address = address;
+    rec.length = length;
+    rec.type = type;
+    fwrite(&rec, sizeof(rec), 1, fp);
+    fwrite(data, 1, length, fp);
+}
+
+/*
+ * The trace the HAL would record for the simulated device: per interrupt, the
+ * mpuirq_data, the FIFO count, the FIFO data, the overflow check and the
+ * compass sample. The DMP ends each packet with a footer, which stays in the
+ * FIFO until the next read.
+ */
+static void write_trace(FILE *fp, const struct sample *s, int num)
+{
+    static const unsigned char footer[2] = { 0xB2, 0x6A };
+    unsigned long long t = inv_get_tick_count() * 1000000ULL;
+    int i, j;
+
+    for (i = 0; i < num; i++) {
+        unsigned char irq[24], count[2], fifo[PACKET_SIZE], status = 0;
+        unsigned char compass[6];
+        unsigned short len = 0;
+
+        t += STEP_MS * 1000000ULL;
+        /* struct mpuirq_data as laid out on the device */
+        memset(irq, 0, sizeof(irq));
+        memcpy(&irq[0], &i, sizeof(int));
+        memcpy(&irq[8], &t, sizeof(t));
+        trace_record(fp, t, MLSL_TRACE_IRQ, 0, sizeof(irq), irq);
+
+        if (i) {
+            memcpy(&fifo[len], footer, sizeof(footer));
+            len += sizeof(footer);
+        }
+        memcpy(&fifo[len], s[i].packet, PACKET_SIZE - sizeof(footer));
+        len += PACKET_SIZE - sizeof(footer);
+        count[0] = (unsigned char)((len + sizeof(footer)) >> 8);
+        count[1] = (unsigned char)((len + sizeof(footer)) & 0xff);
+        trace_record(fp, t, MLSL_TRACE_READ, MPUREG_FIFO_COUNTH,
+                     sizeof(count), count);
+        trace_record(fp, t, MLSL_TRACE_READ_FIFO, MPUREG_FIFO_R_W, len,
+                     fifo);
+        trace_record(fp, t, MLSL_TRACE_READ, MPUREG_INT_STATUS, 1, &status);
+
+        for (j = 0; j < COMPASS_NUM_AXES; j++) {
+            compass[2 * j] = (unsigned char)((s[i].compass[j] >> 8) & 0xff);
+            compass[2 * j + 1] = (unsigned char)(s[i].compass[j] & 0xff);
+        }
+        trace_record(fp, t, MLSL_TRACE_SLAVE_READ, EXT_SLAVE_TYPE_COMPASS,
+                     sizeof(compass), compass);
+    }
+}
+
+/* replays a trace of the simulated device, the outputs must be the ones of
+   the packets it was built from */
+static void bench_replay(void)
+{
+    double ns, quat_err = 0, gyro_err = 0, field_err = 0;
+    FILE *fp;
+    int i, j;
+
+    for (i = 0; i < REPLAY_STEPS; i++)
+        simulate(&trajectory[i], (SIM_STEPS + CHECK_STEPS + i) *
+                 STEP_MS / 1000.0, STEP_MS);
+
+    fp = tmpfile();
+    if (!fp) {
+        perror("tmpfile");
+        exit(EXIT_FAILURE);
+    }
+    write_trace(fp, trajectory, REPLAY_STEPS);
+    rewind(fp);
+    ns = replay_trace(fp);
+    fclose(fp);
+
+    for (i = 0; i < replayed.num && i < REPLAY_STEPS; i++) {
+        const float *v = replayed.out[i].v;
+
+        for (j = 0; j < 4; j++)
+            quat_err = fmax(quat_err, output_diff(v[9 + j],
+                                                  trajectory[i].quat[j]));
+        for (j = 0; j < 3; j++) {
+            gyro_err = fmax(gyro_err, output_diff(v[j],
+                                                  trajectory[i].gyro_dps[j]));
+            field_err = fmax(field_err,
+                             output_diff(v[6 + j], trajectory[i].field_ut[j]));
+        }
+    }
+
+    report("inv_update_data replay", ns, quat_err, 1e-7, "");
+    report("replay FIFO packets", NAN,
+           abs(replayed.num - REPLAY_STEPS) + replayed.errors, 0, "");
+    report("replay gyro", NAN, gyro_err, 2 / Q16, "dps");
+    report("replay magnetic field", NAN, field_err,
+           MLBENCH_COMPASS_RANGE_UT / 32768, "uT");
+}
+
+/* ------------------------------------------------------------------------ */
+/* host fusion                                                              */
+
+static const struct replay_output *fusion_in;
+static float fusion_dt;
+
+/* as MPLSensor::updateHostFusion() */
+static void fusion_update(const struct replay_output *o)
+{
+    float gyro[3];
+    int ii;
+
+    for (ii = 0; ii < 3; ii++)
+        gyro[ii] = o->v[ii] * M_PI / 180.0;
+    mlbench_fusion_update(gyro, &o->v[3], isnan(o->v[6]) ? NULL : &o->v[6],
+                          fusion_dt);
+}
+
+static void loop_fusion(int n)
+{
+    int i;
+
+    mlbench_fusion_reset();
+    for (i = 0; i < n; i++)
+        fusion_update(&fusion_in[i]);
+}
+
+/* angle between the HostFusion attitude and the DMP quaternion of each
+   packet, in degrees, after settle_s for the estimator to converge */
+static void fusion_error(int num, double settle_s, double *max, double *rms)
+{
+    double sum = 0;
+    long q[4];
+    int i, ii, n = 0;
+
+    *max = 0;
+    mlbench_fusion_reset();
+    for (i = 0; i < num; i++) {
+        const float *dmp = &fusion_in[i].v[9];
+        double dot = 0, angle;
+
+        fusion_update(&fusion_in[i]);
+        if (i * fusion_dt < settle_s || isnan(dmp[0]))
+            continue;
+        if (!mlbench_fusion_quaternion(q)) {
+            *max = INFINITY;
+            continue;
+        }
+        for (ii = 0; ii < 4; ii++)
+            dot += q[ii] / Q30 * dmp[ii];
+        angle = 2 * acos(fmin(fabs(dot), 1.0)) * 180 / M_PI;
+        *max = fmax(*max, angle);
+        sum += angle * angle;
+        n++;
+    }
+    *rms = n ? sqrt(sum / n) : INFINITY;
+}
+
+/* HostFusion on the packets replayed by bench_replay(), whose DMP quaternion
+   is the simulated attitude */
+static void bench_fusion(void)
+{
+    double ns, max, rms;
+
+    fusion_in = replayed.out;
+    fusion_dt = STEP_MS / 1000.0;
+    ns = time_loop(loop_fusion, replayed.num);
+    fusion_error(replayed.num, FUSION_SETTLE_S, &max, &rms);
+    /* the 0.1 g shaking of simulate() pulls the default gains a few degrees
+       off, the simulated DMP quaternion itself is exact */
+    report("HostFusion update", ns, max, 6.0, "deg");
+    report("HostFusion rms vs DMP", NAN, rms, 3.5, "deg");
+}
+
+/* ------------------------------------------------------------------------ */
+/* sample clock                                                             */
+
+#define CLOCK_IRQS          (6000)
+/* interrupts the fit needs to settle after a reset */
+#define CLOCK_SETTLE        (64)
+
+/* the interrupts of a FIFO clock, and the true time of their last sample */
+static struct {
+    long long irq_time[CLOCK_IRQS];
+    int count[CLOCK_IRQS];
+    long long nominal[CLOCK_IRQS];
+    double truth[CLOCK_IRQS];
+    double period[CLOCK_IRQS];
+    int num;
+    double t;
+} irqs;
+
+/* num interrupts of 1 to 3 samples of the given true period, each read 20 to
+   300 us late, and 1 ms later once in a while */
+static void clock_irqs(int num, double period, long long nominal)
+{
+    int i;
+
+    for (i = 0; i < num && irqs.num < CLOCK_IRQS; i++) {
+        double latency = 160000 + 140000 * frand();
+        int count = 1 + (int)((1 + frand()) * 1.5);
+
+        if (frand() > 0.98)
+            latency += 1000000;
+        irqs.t += period * count;
+        irqs.irq_time[irqs.num] = (long long)(irqs.t + latency);
+        irqs.count[irqs.num] = count;
+        irqs.nominal[irqs.num] = nominal;
+        irqs.truth[irqs.num] = irqs.t;
+        irqs.period[irqs.num] = period;
+        irqs.num++;
+    }
+}
+
+static void loop_clock(int n)
+{
+    int i;
+
+    mlbench_clock_reset();
+    for (i = 0; i < n; i++)
+        mlbench_clock_update(irqs.irq_time[i], irqs.count[i],
+                             irqs.nominal[i]);
+}
+
+/*
+ * Replays the interrupts from first to last through SampleClock, as
+ * MPLSensor::stampFifoEvents() does. Returns the largest error of the
+ * timestamps after the first settle interrupts, and of the period at the last
+ * one; counts the timestamps out of order.
+ */
+static double clock_error(int first, int last, int settle,
+                          double *period_err, int *disorder)
+{
+    static long long prev;
+    double err = 0;
+    int i, j;
+
+    for (i = first; i < last; i++) {
+        mlbench_clock_update(irqs.irq_time[i], irqs.count[i],
+                             irqs.nominal[i]);
+        for (j = 0; j < irqs.count[i]; j++) {
+            long long t = mlbench_clock_timestamp(j);
+            double truth = irqs.truth[i] -
+                irqs.period[i] * (irqs.count[i] - 1 - j);
+
+            if (t <= prev)
+                (*disorder)++;
+            prev = t;
+            if (i - first >= settle)
+                err = fmax(err, fabs(t - truth));
+        }
+    }
+    *period_err = fabs(mlbench_clock_period() - irqs.period[last - 1]) /
+        irqs.period[last - 1];
+    return err;
+}
+
+static void bench_clock(void)
+{
+    double ns, err, drift_err, lost_err, lost_sync_err, rate_err,
+        rate_sync_err, period_err, drift_period_err, lost_period_err,
+        rate_period_err, unused;
+    int drifting, drift, lost, rate, disorder = 0;
+
+    /* a 5 ms FIFO running 0.3 % slow against the kernel clock */
+    irqs.num = 0;
+    irqs.t = 1e9;
+    clock_irqs(2000, 5015000, 5000000);
+    drifting = irqs.num;
+    /* the oscillator jumps to 2 % fast, still within MAX_DRIFT */
+    clock_irqs(1000, 4900000, 5000000);
+    drift = irqs.num;
+    /* 50 samples never read, the clock must sync again */
+    irqs.t += 50 * 4900000.0;
+    clock_irqs(1500, 4900000, 5000000);
+    lost = irqs.num;
+    /* the HAL asks for 10 ms */
+    clock_irqs(1500, 9800000, 10000000);
+    rate = irqs.num;
+
+    ns = time_loop(loop_clock, irqs.num);
+
+    /* the fit of the 32 last interrupts follows the latency jitter by a few
+       hundred ppm; without it the timestamps would be a period off within a
+       few hundred samples */
+    mlbench_clock_reset();
+    err = clock_error(0, drifting, CLOCK_SETTLE, &period_err, &disorder);
+    drift_err = clock_error(drifting, drift, CLOCK_SETTLE, &drift_period_err,
+                            &disorder);
+    /* right after a reset, the samples are stamped from their interrupt and
+       the nominal period: within the latency, where a clock still fit on
+       the interrupts before would be the 50 samples off */
+    lost_sync_err = clock_error(drift, drift + CLOCK_SETTLE, 0, &unused,
+                                &disorder);
+    lost_err = clock_error(drift + CLOCK_SETTLE, lost, 0, &lost_period_err,
+                           &disorder);
+    rate_sync_err = clock_error(lost, lost + CLOCK_SETTLE, 0, &unused,
+                                &disorder);
+    rate_err = clock_error(lost + CLOCK_SETTLE, rate, 0, &rate_period_err,
+                           &disorder);
+
+    report("SampleClock update", ns, period_err * 1e6, 1000, "ppm");
+    report("SampleClock timestamps", NAN, err / 1000, 500, "us");
+    report("SampleClock drift step period", NAN, drift_period_err * 1e6,
+           1000, "ppm");
+    report("SampleClock drift step", NAN, drift_err / 1000, 500, "us");
+    report("SampleClock lost samples sync", NAN, lost_sync_err / 1000, 2000,
+           "us");
+    report("SampleClock lost samples period", NAN, lost_period_err * 1e6,
+           1000, "ppm");
+    report("SampleClock lost samples", NAN, lost_err / 1000, 500, "us");
+    report("SampleClock rate change sync", NAN, rate_sync_err / 1000, 2000,
+           "us");
+    report("SampleClock rate change period", NAN, rate_period_err * 1e6,
+           1000, "ppm");
+    report("SampleClock rate change", NAN, rate_err / 1000, 500, "us");
+    report("SampleClock order", NAN, disorder, 0, "");
+}
+
+static int replay_file(const char *path, const char *out_path,
+                       const char *ref_path)
+{
+    double ns;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    open_mpl();
+    ns = replay_trace(fp);
+    fclose(fp);
+
+    printf("%d FIFO packets, %d inv_update_data errors\n", replayed.num,
+           replayed.errors);
+    report("inv_update_data + handlers", ns, 0, 0, NULL);
+
+    /* the FIFO period of the HAL, from the span of the trace */
+    if (replayed.num > 1) {
+        double max, rms;
+
+        fusion_in = replayed.out;
+        fusion_dt = (replayed.out[replayed.num - 1].irqtime -
+                     replayed.out[0].irqtime) / 1e9 / (replayed.num - 1);
+        report("HostFusion update", time_loop(loop_fusion, replayed.num),
+               0, 0, NULL);
+        fusion_error(replayed.num, FUSION_SETTLE_S, &max, &rms);
+        /* the calibration file is not read, the hard iron must be found
+           again from the trace before the headings can agree */
+        printf("HostFusion vs DMP quaternion: max %.3g deg, rms %.3g deg%s\n",
+               max, rms, inv_obj.got_compass_bias ? "" :
+               " (compass not calibrated)");
+    }
+
+    /* the recorded interrupts through SampleClock, no sample can be stamped
+       after the interrupt that read it */
+    if (replayed.num > 1) {
+        long long nominal = llrint(fusion_dt * 1e9);
+        int i, j, first, late = 0;
+
+        mlbench_clock_reset();
+        for (first = 0; first < replayed.num; first = i) {
+            unsigned long long irqtime = replayed.out[first].irqtime;
+
+            for (i = first; i < replayed.num &&
+                     replayed.out[i].irqtime == irqtime; i++)
+                ;
+            mlbench_clock_update(irqtime, i - first, nominal);
+            for (j = 0; j < i - first; j++)
+                if (mlbench_clock_timestamp(j) > (long long)irqtime)
+                    late++;
+        }
+        printf("SampleClock period %.1f us (%.1f us on average), "
+               "%d timestamps after their interrupt\n",
+               mlbench_clock_period() / 1e3, nominal / 1e3, late);
+    }
+
+    if (out_path) {
+        fp = fopen(out_path, "w");
+        if (!fp) {
+            perror(out_path);
+            return EXIT_FAILURE;
+        }
+        write_outputs(fp);
+        fclose(fp);
+    }
+    if (ref_path) {
+        fp = fopen(ref_path, "r");
+        if (!fp) {
+            perror(ref_path);
+            return EXIT_FAILURE;
+        }
+        compare_outputs(fp);
+        fclose(fp);
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    const char *trace = NULL, *out = NULL, *ref = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:o:c:")) != -1) {
+        switch (opt) {
+        case 't':
+            trace = optarg;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'c':
+            ref = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t trace [-o outputs] "
+                    "[-c reference]]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (trace)
+        return replay_file(trace, out, ref);
+
+    bench_math();
+    bench_compass_filter();
+    open_mpl();
+    bench_getters();
+    bench_supervisor();
+    bench_store_calibration();
+    bench_replay();
+    bench_fusion();
+    bench_clock();
+
+    if (failures)
+        printf("%d cross-checks failed\n", failures);
+    return failures;
+}
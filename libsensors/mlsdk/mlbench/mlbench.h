@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MLBENCH_H
+#define MLBENCH_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Host stand-in for the MPU driver and the serial layer, so that the real
+ * mllite can be opened and fed without a device. Only the state the MPL
+ * reads back is emulated, the DMP does not run: the FIFO packets are built
+ * by the benchmark and given to inv_process_fifo_packet().
+ */
+
+/* full scale of the emulated slaves, as declared in their descriptors */
+#define MLBENCH_ACCEL_RANGE_G       (2.0)
+#define MLBENCH_COMPASS_RANGE_UT    (19660.8)
+
+/* advance the clock returned by inv_get_tick_count() */
+void mlbench_advance_ms(unsigned long ms);
+
+/* sample returned by the next compass reads, in counts of the slave */
+void mlbench_set_compass(const short *raw);
+
+/* calibration files written through inv_serial_write_cal() */
+int mlbench_cal_writes(void);
+
+/*
+ * Replay of a trace recorded with the debug.mpl.trace property. The reads
+ * recorded after an interrupt are given back to the same reads of the MPL,
+ * in order, until the next interrupt of the trace; any other read is served
+ * by the emulated MPU. Returns the number of interrupts of the trace, or -1
+ * if it can not be read.
+ */
+int mlbench_replay_open(FILE *trace);
+void mlbench_replay_close(void);
+
+/* move to the next interrupt of the trace and set the clock to the time it
+   was read at. Returns 0 at the end of the trace. */
+int mlbench_replay_next(unsigned long long *irqtime);
+
+/*
+ * The HostFusion estimator of the HAL, run on the same samples as
+ * MPLSensor::updateHostFusion(): gyro in rad/s, accel in g, mag in uT or
+ * NULL. The quaternion is the one of HostFusion::getQuaternion(), given only
+ * once the estimator is aligned; returns 0 before.
+ */
+void mlbench_fusion_reset(void);
+void mlbench_fusion_update(const float *gyro, const float *accel,
+                           const float *mag, float dt);
+int mlbench_fusion_quaternion(long *quat);
+
+/* the SampleClock of the HAL, fed as in MPLSensor::stampFifoEvents(): times
+   and periods in ns */
+void mlbench_clock_reset(void);
+void mlbench_clock_update(long long irq_time, int count, long long period);
+long long mlbench_clock_timestamp(int sample);
+long long mlbench_clock_period(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* the SampleClock of the HAL, for the C benchmarks */
+
+#include "SampleClock.h"
+
+#include "mlbench.h"
+
+static SampleClock sample_clock;
+
+void mlbench_clock_reset(void)
+{
+    sample_clock.reset();
+}
+
+void mlbench_clock_update(long long irq_time, int count, long long period)
+{
+    sample_clock.update(irq_time, count, period);
+}
+
+long long mlbench_clock_timestamp(int sample)
+{
+    return sample_clock.timestamp(sample);
+}
+
+long long mlbench_clock_period(void)
+{
+    return sample_clock.period();
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* the HostFusion estimator of the HAL, for the C benchmarks */
+
+#include "HostFusion.h"
+
+#include "mlbench.h"
+
+static HostFusion fusion;
+
+void mlbench_fusion_reset(void)
+{
+    fusion.reset();
+}
+
+void mlbench_fusion_update(const float *gyro, const float *accel,
+                           const float *mag, float dt)
+{
+    fusion.update(gyro, accel, mag, dt);
+}
+
+int mlbench_fusion_quaternion(long *quat)
+{
+    if (!fusion.valid())
+        return 0;
+    fusion.getQuaternion(quat);
+    return 1;
+}
@@ -0,0 +1,500 @@
+/*
+ * Copyright (C) 2011 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Emulated MPU3050 for mlbench: replaces libmlplatform (mlsl_linux_mpu.c and
+ * mlos_linux.c) and, through -Wl,--wrap=ioctl, the /dev/mpu driver.
+ *
+ * It also replays the traces recorded by mlsl_linux_mpu.c: the reads that
+ * followed an interrupt on the device are given back, in order, to the same
+ * reads of the MPL.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpu.h"
+#include "mpu3050.h"
+#include "mlsl.h"
+#include "mlos.h"
+#include "mldl_cfg.h"
+
+#include "mlbench.h"
+
+/* any value, the handle is only given back to the emulated ioctl */
+#define MLBENCH_HANDLE      (3)
+
+static unsigned char regs[256];
+static unsigned char mem[MPU_MEM_NUM_RAM_BANKS * MPU_MEM_BANK_SIZE];
+static unsigned long ticks = 1;
+static unsigned char compass_data[6];
+
+/* ------------------------------------------------------------------------ */
+/* trace replay                                                             */
+
+/* offset of the irqtime in the mpuirq_data of an MLSL_TRACE_IRQ record, as
+   laid out by the device */
+#define TRACE_IRQTIME_OFFSET    (8)
+
+struct replay_record {
+    struct mlsl_trace_record hdr;
+    const unsigned char *data;
+    int consumed;
+};
+
+static struct {
+    unsigned char *buf;
+    struct replay_record *records;
+    int num;
+    int next;                   /* first record after the current window */
+    int start;                  /* first record of the current window */
+} replay;
+
+int mlbench_replay_open(FILE *fp)
+{
+    size_t size = 0, alloc = 0, pos;
+    int num = 0, irqs = 0;
+
+    mlbench_replay_close();
+
+    for (;;) {
+        size_t n;
+
+        if (size == alloc) {
+            unsigned char *buf;
+
+            alloc = alloc ? 2 * alloc : 1 << 16;
+            buf = realloc(replay.buf, alloc);
+            if (!buf)
+                goto fail;
+            replay.buf = buf;
+        }
+        n = fread(replay.buf + size, 1, alloc - size, fp);
+        if (!n)
+            break;
+        size += n;
+    }
+
+    for (pos = 0; pos + sizeof(struct mlsl_trace_record) <= size; num++) {
+        struct mlsl_trace_record hdr;
+
+        memcpy(&hdr, replay.buf + pos, sizeof(hdr));
+        pos += sizeof(hdr) + hdr.length;
+    }
+    if (pos != size) {
+        fprintf(stderr, "trace truncated after %d records\n", num);
+        goto fail;
+    }
+
+    replay.records = calloc(num ? num : 1, sizeof(*replay.records));
+    if (!replay.records)
+        goto fail;
+    for (pos = 0; replay.num < num; replay.num++) {
+        struct replay_record *rec = &replay.records[replay.num];
+
+        memcpy(&rec->hdr, replay.buf + pos, sizeof(rec->hdr));
+        rec->data = replay.buf + pos + sizeof(rec->hdr);
+        pos += sizeof(rec->hdr) + rec->hdr.length;
+        if (rec->hdr.type == MLSL_TRACE_IRQ)
+            irqs++;
+    }
+    return irqs;
+
+fail:
+    mlbench_replay_close();
+    return -1;
+}
+
+void mlbench_replay_close(void)
+{
+    free(replay.buf);
+    free(replay.records);
+    memset(&replay, 0, sizeof(replay));
+}
+
+int mlbench_replay_next(unsigned long long *irqtime)
+{
+    struct replay_record *rec;
+
+    while (replay.next < replay.num &&
+           replay.records[replay.next].hdr.type != MLSL_TRACE_IRQ)
+        replay.next++;
+    if (replay.next == replay.num)
+        return 0;
+
+    /* the HAL reads all the irq files before updating the MPL, and stamps
+       the events with the last interrupt time */
+    do {
+        rec = &replay.records[replay.next++];
+        if (rec->hdr.length >= TRACE_IRQTIME_OFFSET + sizeof(*irqtime))
+            memcpy(irqtime, rec->data + TRACE_IRQTIME_OFFSET,
+                   sizeof(*irqtime));
+        else
+            *irqtime = rec->hdr.timestamp;
+        ticks = (unsigned long)(rec->hdr.timestamp / 1000000);
+    } while (replay.next < replay.num &&
+             replay.records[replay.next].hdr.type == MLSL_TRACE_IRQ);
+
+    replay.start = replay.next;
+    while (replay.next < replay.num &&
+           replay.records[replay.next].hdr.type != MLSL_TRACE_IRQ)
+        replay.next++;
+    return 1;
+}
+
+/*
+ * Next record of the current window for a read of type at address. The data
+ * is copied to the read, truncated or zero filled to its length. Returns 0
+ * and leaves data untouched if the window has no such read left.
+ */
+static int replay_read(unsigned char type, unsigned short address,
+                       unsigned short length, unsigned char *data,
+                       int *result)
+{
+    int ii;
+
+    for (ii = replay.start; ii < replay.next; ii++) {
+        struct replay_record *rec = &replay.records[ii];
+
+        if (rec->consumed || rec->hdr.type != type ||
+            rec->hdr.address != address)
+            continue;
+        rec->consumed = 1;
+        memset(data, 0, length);
+        memcpy(data, rec->data,
+               rec->hdr.length < length ? rec->hdr.length : length);
+        *result = rec->hdr.result;
+        return 1;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/* driver side state, what the kernel keeps behind /dev/mpu                 */
+
+static int slave_nop(void *mlsl_handle __unused,
+                     struct ext_slave_descr *slave __unused,
+                     struct ext_slave_platform_data *pdata __unused)
+{
+    return 0;
+}
+
+static struct ext_slave_descr accel_descr = {
+    .suspend = slave_nop,
+    .resume = slave_nop,
+    .name = "bma250",
+    .type = EXT_SLAVE_TYPE_ACCELEROMETER,
+    .id = ACCEL_ID_BMA250,
+    .read_reg = 0x02,
+    .read_len = 6,
+    .endian = EXT_SLAVE_LITTLE_ENDIAN,
+    .range = {2, 0},
+};
+
+static struct ext_slave_descr compass_descr = {
+    .suspend = slave_nop,
+    .resume = slave_nop,
+    .name = "yas530",
+    .type = EXT_SLAVE_TYPE_COMPASS,
+    .id = COMPASS_ID_YAS530,
+    .read_reg = 0x06,
+    .read_len = 6,
+    .endian = EXT_SLAVE_BIG_ENDIAN,
+    .range = {19660, 8000},
+};
+
+static struct ext_slave_descr *get_accel_descr(void)
+{
+    return &accel_descr;
+}
+
+static struct ext_slave_descr *get_compass_descr(void)
+{
+    return &compass_descr;
+}
+
+static struct mpu_platform_data pdata = {
+    .int_config = 0x10,
+    .orientation = {1, 0, 0, 0, 1, 0, 0, 0, 1},
+    .accel = {
+        .get_slave_descr = get_accel_descr,
+        .bus = EXT_SLAVE_BUS_SECONDARY,
+        .address = 0x18,
+        .orientation = {1, 0, 0, 0, 1, 0, 0, 0, 1},
+    },
+    .compass = {
+        .get_slave_descr = get_compass_descr,
+        .bus = EXT_SLAVE_BUS_PRIMARY,
+        .address = 0x2e,
+        .orientation = {1, 0, 0, 0, 1, 0, 0, 0, 1},
+    },
+};
+
+static struct mldl_cfg dev_cfg = {
+    .addr = 0x68,
+    .full_scale = MPU_FS_2000DPS,
+    .lpf = MPU_FILTER_42HZ,
+    .clk_src = MPU_CLK_SEL_PLLGYROZ,
+    .divider = 4,
+    .silicon_revision = 1,
+    .product_id = 0x68,
+    .gyro_sens_trim = 131,
+    .gyro_is_suspended = 1,
+    .accel_is_suspended = 1,
+    .compass_is_suspended = 1,
+    .pressure_is_suspended = 1,
+};
+
+/* copy the configuration, the pointers of each side are kept */
+static void copy_cfg(struct mldl_cfg *to, const struct mldl_cfg *from)
+{
+    struct ext_slave_descr *accel = to->accel;
+    struct ext_slave_descr *compass = to->compass;
+    struct ext_slave_descr *pressure = to->pressure;
+    struct mpu_platform_data *platform = to->pdata;
+
+    *to = *from;
+    to->accel = accel;
+    to->compass = compass;
+    to->pressure = pressure;
+    to->pdata = platform;
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+    struct mldl_cfg *cfg;
+    void *arg;
+    va_list ap;
+    int result;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+    cfg = arg;
+
+    if (fd != MLBENCH_HANDLE) {
+        errno = EBADF;
+        return -1;
+    }
+
+    switch (request) {
+    case MPU_GET_MPU_CONFIG:
+        copy_cfg(cfg, &dev_cfg);
+        if (cfg->accel)
+            *cfg->accel = accel_descr;
+        if (cfg->compass)
+            *cfg->compass = compass_descr;
+        if (cfg->pressure)
+            memset(cfg->pressure, 0, sizeof(*cfg->pressure));
+        if (cfg->pdata)
+            *cfg->pdata = pdata;
+        return 0;
+    case MPU_SET_MPU_CONFIG:
+        copy_cfg(&dev_cfg, cfg);
+        return 0;
+    case MPU_RESUME:
+        dev_cfg.gyro_is_suspended = 0;
+        dev_cfg.accel_is_suspended = 0;
+        dev_cfg.compass_is_suspended = 0;
+        return 0;
+    case MPU_SUSPEND:
+        dev_cfg.gyro_is_suspended = 1;
+        dev_cfg.accel_is_suspended = 1;
+        dev_cfg.compass_is_suspended = 1;
+        return 0;
+    case MPU_READ_ACCEL:
+        if (replay_read(MLSL_TRACE_SLAVE_READ, EXT_SLAVE_TYPE_ACCELEROMETER,
+                        accel_descr.read_len, arg, &result))
+            return result;
+        memset(arg, 0, accel_descr.read_len);
+        return 0;
+    case MPU_READ_COMPASS:
+        if (replay_read(MLSL_TRACE_SLAVE_READ, EXT_SLAVE_TYPE_COMPASS,
+                        compass_descr.read_len, arg, &result))
+            return result;
+        memcpy(arg, compass_data, compass_descr.read_len);
+        return 0;
+    case MPU_CONFIG_ACCEL:
+    case MPU_CONFIG_COMPASS:
+        return 0;
+    default:
+        /* no slave specific configuration to read back */
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+void mlbench_set_compass(const short *raw)
+{
+    int ii;
+
+    for (ii = 0; ii < COMPASS_NUM_AXES; ii++) {
+        compass_data[2 * ii] = (unsigned char)((raw[ii] >> 8) & 0xff);
+        compass_data[2 * ii + 1] = (unsigned char)(raw[ii] & 0xff);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* serial layer                                                             */
+
+inv_error_t inv_serial_open(char const *port __unused, void **sl_handle)
+{
+    regs[MPUREG_WHO_AM_I] = 0x68;
+    regs[MPUREG_PRODUCT_ID] = dev_cfg.product_id;
+    *sl_handle = (void *)(uintptr_t)MLBENCH_HANDLE;
+    return INV_SUCCESS;
+}
+
+inv_error_t inv_serial_close(void *sl_handle __unused)
+{
+    return INV_SUCCESS;
+}
+
+inv_error_t inv_serial_single_write(void *sl_handle __unused,
+                                    unsigned char slave_addr __unused,
+                                    unsigned char register_addr,
+                                    unsigned char data)
+{
+    regs[register_addr] = data;
+    return INV_SUCCESS;
+}
+
+inv_error_t inv_serial_write(void *sl_handle __unused,
+                             unsigned char slave_addr __unused,
+                             unsigned short length,
+                             unsigned char const *data)
+{
+    unsigned short ii;
+
+    if (length < 1 || data[0] + length - 1 > (int)sizeof(regs))
+        return INV_ERROR_INVALID_PARAMETER;
+    for (ii = 1; ii < length; ii++)
+        regs[data[0] + ii - 1] = data[ii];
+    return INV_SUCCESS;
+}
+
+inv_error_t inv_serial_read(void *sl_handle __unused,
+                            unsigned char slave_addr __unused,
+                            unsigned char register_addr,
+                            unsigned short length,
+                            unsigned char *data)
+{
+    int result;
+
+    if (register_addr + length > (int)sizeof(regs))
+        return INV_ERROR_INVALID_PARAMETER;
+    if (replay_read(MLSL_TRACE_READ, register_addr, length, data, &result))
+        return result;
+    /* out of a replay the FIFO always reads empty */
+    if (register_addr == MPUREG_FIFO_COUNTH) {
+        memset(data, 0, length);
+        return INV_SUCCESS;
+    }
+    memcpy(data, &regs[register_addr], length);
+    return INV_SUCCESS;
+}
+
+inv_error_t inv_serial_read_mem(void *sl_handle __unused,
+                                unsigned char slave_addr __unused,
+                                unsigned short mem_addr,
+                                unsigned short length,
+                                unsigned char *data)
+{
+    int result;
+
+    if (mem_addr + length > (int)sizeof(mem))
+        return INV_ERROR_INVALID_PARAMETER;
+    if (replay_read(MLSL_TRACE_READ_MEM, mem_addr, length, data, &result))
+        return result;
+    memcpy(data, &mem[mem_addr], length);
+    return INV_SUCCESS;
+}
+
+inv_error_t inv_serial_write_mem(void *sl_handle __unused,
+                                 unsigned char slave_addr __unused,
+                                 unsigned short mem_addr,
+                                 unsigned short length,
+                                 unsigned char const *data)
+{
+    if (mem_addr + length > (int)sizeof(mem))
+        return INV_ERROR_INVALID_PARAMETER;
+    memcpy(&mem[mem_addr], data, length);
+    return INV_SUCCESS;
+}
+
+inv_error_t inv_serial_read_fifo(void *sl_handle __unused,
+                                 unsigned char slave_addr __unused,
+                                 unsigned short length,
+                                 unsigned char *data)
+{
+    int result;
+
+    if (replay_read(MLSL_TRACE_READ_FIFO, MPUREG_FIFO_R_W, length, data,
+                    &result))
+        return result;
+    memset(data, 0, length);
+    return INV_SUCCESS;
+}
+
+/* no calibration file, the MPL starts from its defaults */
+inv_error_t inv_serial_read_cal(unsigned char *cal __unused,
+                                unsigned int len __unused)
+{
+    return INV_ERROR_FILE_OPEN;
+}
+
+static int cal_writes;
+
+int mlbench_cal_writes(void)
+{
+    return cal_writes;
+}
+
+inv_error_t inv_serial_write_cal(unsigned char *cal __unused,
+                                 unsigned int len __unused)
+{
+    cal_writes++;
+    return INV_SUCCESS;
+}
+
+inv_error_t inv_serial_get_cal_length(unsigned int *len __unused)
+{
+    return INV_ERROR_FILE_OPEN;
+}
+
+void inv_serial_trace(unsigned char type __unused,
+                      unsigned short address __unused, int result __unused,
+                      unsigned short length __unused,
+                      unsigned char const *data __unused)
+{
+}
+
+/* ------------------------------------------------------------------------ */
+/* os layer                                                                 */
+
+unsigned long inv_get_tick_count(void)
+{
+    return ticks;
+}
+
+void mlbench_advance_ms(unsigned long ms)
+{
+    ticks += ms;
+}
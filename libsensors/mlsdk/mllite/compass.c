@@ -85,15 +85,39 @@ static void adaptive_filter_init(struct yas_adaptive_filter *adap_filter)
     adap_filter->len = YAS_DEFAULT_FILTER_LEN;
 }
 
-static int cmpfloat(const void *p1, const void *p2)
+/**
+ *  @internal
+ *  @brief  Replace one sample of a sorted window by another.
+ *          The slot of the outgoing sample is reused and moved toward
+ *          the position of the incoming one, so only the entries
+ *          between the two are shifted.
+ *  @param  sorted  the window, in ascending order.
+ *  @param  n       number of samples in the window.
+ *  @param  out     sample leaving the window; must be present in it.
+ *  @param  in      sample entering the window.
+ */
+static void adaptive_filter_replace(float *sorted, int n, float out, float in)
 {
-    return *(float*)p1 - *(float*)p2;
-}
+    int i = 0;
 
+    while (i < n - 1 && sorted[i] != out) {
+        i++;
+    }
+    while (i > 0 && in < sorted[i - 1]) {
+        sorted[i] = sorted[i - 1];
+        i--;
+    }
+    while (i < n - 1 && sorted[i + 1] < in) {
+        sorted[i] = sorted[i + 1];
+        i++;
+    }
+    sorted[i] = in;
+}
 
 static float adaptive_filter_filter(struct yas_adaptive_filter *adap_filter, float in)
 {
-    float avg, sum, median, sorted[YAS_DEFAULT_FILTER_LEN];
+    float avg, var, median, out;
+    double mean;
     int i;
     int len = adap_filter->len;
 
@@ -101,6 +125,14 @@ static float adaptive_filter_filter(struct yas_adaptive_filter *adap_filter, flo
         return in;
     }
     if (adap_filter->num < len) {
+        /* still filling the window: insertion sort the new sample */
+        for (i = adap_filter->num; i > 0 && in < adap_filter->sorted[i - 1];
+             i--) {
+            adap_filter->sorted[i] = adap_filter->sorted[i - 1];
+        }
+        adap_filter->sorted[i] = in;
+        adap_filter->sum += in;
+        adap_filter->sum_sq += (double)in * in;
         adap_filter->sequence[adap_filter->index++] = in;
         adap_filter->num++;
         return in;
@@ -108,29 +140,34 @@ static float adaptive_filter_filter(struct yas_adaptive_filter *adap_filter, flo
     if (len <= adap_filter->index) {
         adap_filter->index = 0;
     }
+    out = adap_filter->sequence[adap_filter->index];
+    adaptive_filter_replace(adap_filter->sorted, len, out, in);
     adap_filter->sequence[adap_filter->index++] = in;
 
-    avg = 0;
-    for (i = 0; i < len; i++) {
-        avg += adap_filter->sequence[i];
+    if (adap_filter->index == len) {
+        /* once per window, recompute the sums so rounding can not build up */
+        adap_filter->sum = 0;
+        adap_filter->sum_sq = 0;
+        for (i = 0; i < len; i++) {
+            adap_filter->sum += adap_filter->sequence[i];
+            adap_filter->sum_sq +=
+                (double)adap_filter->sequence[i] * adap_filter->sequence[i];
+        }
+    } else {
+        adap_filter->sum += (double)in - out;
+        adap_filter->sum_sq += (double)in * in - (double)out * out;
     }
-    avg /= len;
-
-    memcpy(sorted, adap_filter->sequence, len * sizeof(float));
-    qsort(&sorted, len, sizeof(float), cmpfloat);
-    median = sorted[len/2];
 
-    sum = 0;
-    for (i = 0; i < len; i++) {
-        sum += powf(avg - adap_filter->sequence[i], 2);
-    }
-    sum /= len;
+    mean = adap_filter->sum / len;
+    avg = mean;
+    median = adap_filter->sorted[len/2];
+    var = adap_filter->sum_sq / len - mean * mean;
 
-    if (sum <= adap_filter->noise) {
+    if (var <= adap_filter->noise) {
         return median;
     }
 
-    return ((in - avg) * (sum - adap_filter->noise) / sum + avg);
+    return ((in - avg) * (var - adap_filter->noise) / var + avg);
 }
 
 static void thresh_filter_init(struct yas_thresh_filter *thresh_filter)
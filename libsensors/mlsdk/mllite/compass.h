@@ -49,6 +49,11 @@ struct yas_adaptive_filter {
     int len;
     float noise;
     float sequence[YAS_MAX_FILTER_LEN];
+    /* the window kept in ascending order, updated one sample at a time */
+    float sorted[YAS_MAX_FILTER_LEN];
+    /* running sums of the window for the mean and variance */
+    double sum;
+    double sum_sq;
 };
 
 struct yas_thresh_filter {
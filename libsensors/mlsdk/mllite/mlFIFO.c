@@ -119,11 +119,24 @@ const int fifo_base_offset[NUMFIFOELEMENTS] = {
     REF_GARBAGE * 4
 };
 
+/* Packet byte order of a decoded element */
+#define FIFO_FIELD_16BIT        (0)     // big endian, 16 bits
+#define FIFO_FIELD_16BIT_SWAP   (1)     // little endian, 16 bits
+#define FIFO_FIELD_32BIT        (2)     // big endian, 32 bits
+
+/* One element of the unpack plan built by inv_set_footer() */
+struct fifo_field {
+    unsigned char ref;          // index in decoded
+    unsigned char offset;       // byte offset in the packet
+    unsigned char format;       // FIFO_FIELD_*
+};
+
 struct fifo_obj {
     void (*fifo_process_cb) (void);
     long decoded[REF_LAST];
     long decoded_accel[INV_MAX_NUM_ACCEL_SAMPLES][ACCEL_NUM_AXES];
-    int offsets[REF_LAST * 4];
+    struct fifo_field fields[REF_LAST];
+    int num_fields;
     int cache;
     uint_fast8_t gyro_source;
     unsigned short fifo_rate;
@@ -255,36 +268,41 @@ static inv_error_t inv_set_footer(void)
     unsigned char regs = DINA30;
     uint_fast8_t tmp_count;
     int_fast8_t i, j;
-    int offset;
+    int ref;
     int result;
-    int *fifo_offsets_ptr = fifo_obj.offsets;
+    struct fifo_field *field = fifo_obj.fields;
 
+    // Build the unpack plan of the packet along with its size. The footer
+    // goes to REF_GARBAGE, which is never read, so it is not unpacked.
     fifo_obj.fifo_packet_size = 0;
     for (i = 0; i < NUMFIFOELEMENTS; i++) {
         tmp_count = 0;
-        offset = fifo_base_offset[i];
+        ref = fifo_base_offset[i] / 4;
         for (j = 0; j < 8; j++) {
             if ((fifo_obj.data_config[i] >> j) & 0x0001) {
+                unsigned char format;
+
                 // Special Case for Byte Ordering on Accel Data
                 if ((i == CONFIG_RAW_DATA) && (j > 2)) {
-                    tmp_count += 2;
-                    *fifo_offsets_ptr++ = offset + 2;
-                    *fifo_offsets_ptr++ = offset + 3;
+                    format = FIFO_FIELD_16BIT_SWAP;
+                } else if (fifo_obj.data_config[i] & INV_32_BIT) {
+                    format = FIFO_FIELD_32BIT;
                 } else {
-                    tmp_count += 2;
-                    *fifo_offsets_ptr++ = offset + 3;
-                    *fifo_offsets_ptr++ = offset + 2;
-                    if (fifo_obj.data_config[i] & INV_32_BIT) {
-                        *fifo_offsets_ptr++ = offset + 1;
-                        *fifo_offsets_ptr++ = offset;
-                        tmp_count += 2;
-                    }
+                    format = FIFO_FIELD_16BIT;
                 }
+                if (i != CONFIG_FOOTER) {
+                    field->ref = ref;
+                    field->offset = fifo_obj.fifo_packet_size + tmp_count;
+                    field->format = format;
+                    field++;
+                }
+                tmp_count += (format == FIFO_FIELD_32BIT) ? 4 : 2;
             }
-            offset += 4;
+            ref++;
         }
         fifo_obj.fifo_packet_size += tmp_count;
     }
+    fifo_obj.num_fields = field - fifo_obj.fields;
     if (fifo_obj.data_config[CONFIG_FOOTER] == 0 &&
         fifo_obj.fifo_packet_size > 0) {
         // Add footer
@@ -494,31 +512,41 @@ inv_error_t inv_read_and_process_fifo(int_fast8_t numPackets,
 {
     int_fast8_t packet;
     inv_error_t result = INV_SUCCESS;
-    uint_fast16_t read;
     struct mldl_cfg *mldl_cfg = inv_get_dl_config();
+    unsigned char footer_n_data[FIFO_HW_SIZE + FIFO_FOOTER_SIZE];
     int kk;
 
     if (NULL == processed)
         return INV_ERROR_INVALID_PARAMETER;
 
     *processed = 0;
-    if (fifo_obj.fifo_packet_size == 0)
+    if (fifo_obj.fifo_packet_size == 0 || numPackets <= 0)
         return result;          // Nothing to read
 
+    if (mldl_cfg->requested_sensors & INV_DMP_PROCESSOR) {
+        // Read all the whole packets at once, the FIFO holds less than
+        // FIFO_HW_SIZE bytes of them
+        uint_fast16_t maxPackets = FIFO_HW_SIZE / fifo_obj.fifo_packet_size;
+        uint_fast16_t read;
+
+        if ((uint_fast16_t) numPackets < maxPackets)
+            maxPackets = numPackets;
+        read = inv_get_fifo_packets((uint_fast16_t) fifo_obj.fifo_packet_size,
+                                    maxPackets, footer_n_data);
+        if (0 == read) {
+            result = inv_get_fifo_status();
+            if (INV_SUCCESS != result) {
+                memset(fifo_obj.decoded, 0, sizeof(fifo_obj.decoded));
+            }
+            return result;
+        }
+        numPackets = read;
+    }
+
     for (packet = 0; packet < numPackets; ++packet) {
         if (mldl_cfg->requested_sensors & INV_DMP_PROCESSOR) {
-            unsigned char footer_n_data[MAX_FIFO_LENGTH + FIFO_FOOTER_SIZE];
-            unsigned char *buf = &footer_n_data[FIFO_FOOTER_SIZE];
-            read = inv_get_fifo((uint_fast16_t) fifo_obj.fifo_packet_size,
-                                footer_n_data);
-            if (0 == read ||
-                read != fifo_obj.fifo_packet_size - FIFO_FOOTER_SIZE) {
-                result = inv_get_fifo_status();
-                if (INV_SUCCESS != result) {
-                    memset(fifo_obj.decoded, 0, sizeof(fifo_obj.decoded));
-                }
-                return result;
-            }
+            unsigned char *buf = &footer_n_data[FIFO_FOOTER_SIZE +
+                                               packet * fifo_obj.fifo_packet_size];
 
             result = inv_process_fifo_packet(buf);
             if (result) {
@@ -625,25 +653,39 @@ inv_error_t inv_set_fifo_processed_callback(void (*func) (void))
 inv_error_t inv_process_fifo_packet(const unsigned char *dmpData)
 {
     INVENSENSE_FUNC_START;
-    unsigned int N, kk;
-    unsigned char *p;
+    const struct fifo_field *field = fifo_obj.fields;
+    const struct fifo_field *end = field + fifo_obj.num_fields;
 
-    p = (unsigned char *)(&fifo_obj.decoded);
-    N = fifo_obj.fifo_packet_size;
-    if (N > sizeof(fifo_obj.decoded))
+    if (fifo_obj.fifo_packet_size > sizeof(fifo_obj.decoded))
         return INV_ERROR_ASSERTION_FAILURE;
 
     memset(&fifo_obj.decoded, 0, sizeof(fifo_obj.decoded));
 
-    for (kk = 0; kk < N; ++kk) {
-        p[fifo_obj.offsets[kk]] = *dmpData++;
-    }
+    // Only the elements sent through the FIFO are unpacked and scaled,
+    // all the others are left to 0
+    for (; field < end; ++field) {
+        const unsigned char *p = dmpData + field->offset;
+        long value;
+
+        switch (field->format) {
+        case FIFO_FIELD_32BIT:
+            value = (int32_t)(((uint32_t)p[0] << 24) |
+                              ((uint32_t)p[1] << 16) |
+                              ((uint32_t)p[2] << 8) | p[3]);
+            break;
+        case FIFO_FIELD_16BIT_SWAP:
+            value = (int32_t)(((uint32_t)p[1] << 24) |
+                              ((uint32_t)p[0] << 16));
+            break;
+        default:
+            value = (int32_t)(((uint32_t)p[0] << 24) |
+                              ((uint32_t)p[1] << 16));
+            break;
+        }
 
-    // If multiplies are much greater cost than if checks, you could check
-    // to see if fifo_scale is non-zero first, or equal to (1L<<30)
-    for (kk = 0; kk < REF_LAST; ++kk) {
-        fifo_obj.decoded[kk] =
-            inv_q30_mult(fifo_obj.decoded[kk], fifo_scale[kk]);
+        if (fifo_scale[field->ref] != (1L << 30))
+            value = inv_q30_mult(value, fifo_scale[field->ref]);
+        fifo_obj.decoded[field->ref] = value;
     }
 
     memcpy(&fifo_obj.decoded[REF_QUATERNION_6AXIS],
@@ -101,16 +101,45 @@ void inv_init_fifo_hardare(void)
  *  @return number of valid bytes of data.
 **/
 uint_fast16_t inv_get_fifo(uint_fast16_t length, unsigned char *buffer)
+{
+    INVENSENSE_FUNC_START;
+
+    if (inv_get_fifo_packets(length, 1, buffer) == 0)
+        return 0;
+    return length - FIFO_FOOTER_SIZE;
+}
+
+/**
+ *  @internal
+ *  @brief  used to get all the whole packets in the FIFO with a single
+ *          FIFO count read, a single burst read and a single overflow
+ *          check.
+ *          Packet kk starts at buffer + FIFO_FOOTER_SIZE + kk * length.
+ *  @param  length
+ *              Size of a FIFO packet, footer included.
+ *  @param  maxPackets
+ *              Maximum number of packets to read.
+ *  @param  buffer
+ *              the bytes of FIFO data.
+ *              Note that this buffer <b>must</b> be able to store
+ *              maxPackets * length + FIFO_FOOTER_SIZE bytes.
+ *  @return number of packets read.
+**/
+uint_fast16_t inv_get_fifo_packets(uint_fast16_t length,
+                                   uint_fast16_t maxPackets,
+                                   unsigned char *buffer)
 {
     INVENSENSE_FUNC_START;
     inv_error_t result;
     uint_fast16_t inFifo;
     uint_fast16_t toRead;
-    int_fast8_t kk;
+    uint_fast16_t packets;
+    uint_fast16_t kk;
+    int_fast8_t ii;
 
-    toRead = length - FIFO_FOOTER_SIZE + fifo_objHW.fifoCount;
     /*---- make sure length is correct ----*/
-    if (length > MAX_FIFO_LENGTH || toRead > length || NULL == buffer) {
+    if (length > MAX_FIFO_LENGTH || length < FIFO_FOOTER_SIZE ||
+        maxPackets == 0 || NULL == buffer) {
         fifo_objHW.fifoError = INV_ERROR_INVALID_PARAMETER;
         return 0;
     }
@@ -126,6 +155,12 @@ uint_fast16_t inv_get_fifo(uint_fast16_t length, unsigned char *buffer)
         fifo_objHW.fifoError = INV_SUCCESS;
         return 0;
     }
+    packets = (inFifo - fifo_objHW.fifoCount) / length;
+    if (packets > maxPackets)
+        packets = maxPackets;
+
+    // the footer of the last packet stays in the FIFO for the next read
+    toRead = packets * length - FIFO_FOOTER_SIZE + fifo_objHW.fifoCount;
     // if a trailing fifo count is expected - start storing data 2 bytes before
     result =
         inv_read_fifo(fifo_objHW.fifoCount >
@@ -149,29 +184,24 @@ uint_fast16_t inv_get_fifo(uint_fast16_t length, unsigned char *buffer)
         return 0;
     }
 
-    /* Check the Footer value to give us a chance at making sure data
+    /* Check the Footer values to give us a chance at making sure data
      * didn't get corrupted */
-    for (kk = 0; kk < fifo_objHW.fifoCount; ++kk) {
-        if (buffer[kk] != gFifoFooter[kk]) {
-            MPL_LOGV("Resetting Fifo : Invalid footer : 0x%02x 0x%02x\n",
-                     buffer[0], buffer[1]);
-            _fifoDebug(char out[200];
-                       MPL_LOGW("fifoCount : %d\n", fifo_objHW.fifoCount);
-                       sprintf(out, "0x");
-                       for (kk = 0; kk < (int)toRead; kk++) {
-                       sprintf(out, "%s%02X", out, buffer[kk]);}
-                       MPL_LOGW("%s\n", out);)
+    for (kk = (fifo_objHW.fifoCount ? 0 : 1); kk < packets; ++kk) {
+        unsigned char *footer = buffer + kk * length;
+        for (ii = 0; ii < FIFO_FOOTER_SIZE; ++ii) {
+            if (footer[ii] != gFifoFooter[ii]) {
+                MPL_LOGV("Resetting Fifo : Invalid footer : 0x%02x 0x%02x\n",
+                         footer[0], footer[1]);
                 inv_reset_fifo();
-            fifo_objHW.fifoError = INV_ERROR_FIFO_FOOTER;
-            return 0;
+                fifo_objHW.fifoError = INV_ERROR_FIFO_FOOTER;
+                return 0;
+            }
         }
     }
 
-    if (fifo_objHW.fifoCount == 0) {
-        fifo_objHW.fifoCount = FIFO_FOOTER_SIZE;
-    }
+    fifo_objHW.fifoCount = FIFO_FOOTER_SIZE;
 
-    return length - FIFO_FOOTER_SIZE;
+    return packets;
 }
 
 /**
@@ -89,21 +89,28 @@ void inv_q_invert(const long *q, long *qInverted)
  */
 void inv_quaternion_to_rotation(const long *quat, long *rot)
 {
-    rot[0] =
-        inv_q29_mult(quat[1], quat[1]) + inv_q29_mult(quat[0],
-                                                      quat[0]) - 1073741824L;
-    rot[1] = inv_q29_mult(quat[1], quat[2]) - inv_q29_mult(quat[3], quat[0]);
-    rot[2] = inv_q29_mult(quat[1], quat[3]) + inv_q29_mult(quat[2], quat[0]);
-    rot[3] = inv_q29_mult(quat[1], quat[2]) + inv_q29_mult(quat[3], quat[0]);
-    rot[4] =
-        inv_q29_mult(quat[2], quat[2]) + inv_q29_mult(quat[0],
-                                                      quat[0]) - 1073741824L;
-    rot[5] = inv_q29_mult(quat[2], quat[3]) - inv_q29_mult(quat[1], quat[0]);
-    rot[6] = inv_q29_mult(quat[1], quat[3]) - inv_q29_mult(quat[2], quat[0]);
-    rot[7] = inv_q29_mult(quat[2], quat[3]) + inv_q29_mult(quat[1], quat[0]);
-    rot[8] =
-        inv_q29_mult(quat[3], quat[3]) + inv_q29_mult(quat[0],
-                                                      quat[0]) - 1073741824L;
+    /* q00 is used by the three diagonal elements and each cross product by
+       two off-diagonal ones, compute the 10 distinct products once */
+    long q00 = inv_q29_mult(quat[0], quat[0]);
+    long q01 = inv_q29_mult(quat[1], quat[0]);
+    long q02 = inv_q29_mult(quat[2], quat[0]);
+    long q03 = inv_q29_mult(quat[3], quat[0]);
+    long q11 = inv_q29_mult(quat[1], quat[1]);
+    long q12 = inv_q29_mult(quat[1], quat[2]);
+    long q13 = inv_q29_mult(quat[1], quat[3]);
+    long q22 = inv_q29_mult(quat[2], quat[2]);
+    long q23 = inv_q29_mult(quat[2], quat[3]);
+    long q33 = inv_q29_mult(quat[3], quat[3]);
+
+    rot[0] = q11 + q00 - 1073741824L;
+    rot[1] = q12 - q03;
+    rot[2] = q13 + q02;
+    rot[3] = q12 + q03;
+    rot[4] = q22 + q00 - 1073741824L;
+    rot[5] = q23 - q01;
+    rot[6] = q13 - q02;
+    rot[7] = q23 + q01;
+    rot[8] = q33 + q00 - 1073741824L;
 }
 
 /** Converts a 32-bit long to a big endian byte stream */
@@ -148,22 +155,214 @@ void inv_matrix_det_inc(float *a, float *b, int *n, int x, int y)
     *n = *n - 1;
 }
 
+/** Computes the determinant of a square matrix.
+ * @param[in] p Matrix, rows are 10 elements apart.
+ * @param[in] n Size of the matrix, at most 10.
+ * @return Determinant
+ */
 float inv_matrix_det(float *p, int *n)
 {
-    float d[10][10], sum = 0;
-    int i, j, m;
-    m = *n;
+    float lu[10][10];
+    int perm[10];
+    float det;
+    int i, j;
+
     if (*n == 2)
         return (*p ** (p + 11) - *(p + 1) ** (p + 10));
-    for (i = 0, j = 0; j < m; j++) {
-        *n = m;
-        inv_matrix_det_inc(p, &d[0][0], n, i, j);
-        sum =
-            sum + *(p + 10 * i + j) * SIGNM(i + j) * inv_matrix_det(&d[0][0],
-                                                                    n);
+    if (*n == 3) {
+        float m[9];
+        for (i = 0; i < 3; i++)
+            for (j = 0; j < 3; j++)
+                m[3 * i + j] = p[10 * i + j];
+        return inv_matrix_det3(m);
     }
 
-    return (sum);
+    for (i = 0; i < *n; i++)
+        for (j = 0; j < *n; j++)
+            lu[i][j] = p[10 * i + j];
+    det = (float)inv_matrix_lu(&lu[0][0], *n, 10, perm);
+    for (i = 0; i < *n; i++)
+        det *= lu[i][i];
+    return det;
+}
+
+/** Determinant of a 3x3 matrix, stored by rows. */
+float inv_matrix_det3(const float *m)
+{
+    return m[0] * (m[4] * m[8] - m[5] * m[7]) -
+        m[1] * (m[3] * m[8] - m[5] * m[6]) +
+        m[2] * (m[3] * m[7] - m[4] * m[6]);
+}
+
+/** Inverse of a 3x3 matrix, stored by rows.
+ * @param[in] m Matrix
+ * @param[out] inv Inverse, must not be m
+ * @return INV_SUCCESS, or INV_ERROR_DIVIDE_BY_ZERO if m is singular.
+ */
+inv_error_t inv_matrix_inverse3(const float *m, float *inv)
+{
+    float det = inv_matrix_det3(m);
+    float r;
+
+    if (det == 0)
+        return INV_ERROR_DIVIDE_BY_ZERO;
+    r = 1.0f / det;
+
+    inv[0] = (m[4] * m[8] - m[5] * m[7]) * r;
+    inv[1] = (m[2] * m[7] - m[1] * m[8]) * r;
+    inv[2] = (m[1] * m[5] - m[2] * m[4]) * r;
+    inv[3] = (m[5] * m[6] - m[3] * m[8]) * r;
+    inv[4] = (m[0] * m[8] - m[2] * m[6]) * r;
+    inv[5] = (m[2] * m[3] - m[0] * m[5]) * r;
+    inv[6] = (m[3] * m[7] - m[4] * m[6]) * r;
+    inv[7] = (m[1] * m[6] - m[0] * m[7]) * r;
+    inv[8] = (m[0] * m[4] - m[1] * m[3]) * r;
+    return INV_SUCCESS;
+}
+
+/* 2x2 minors of the two top rows (s) and of the two bottom rows (c) of a
+ * 4x4 matrix, shared by the determinant and the inverse */
+static void inv_matrix_minors4(const float *m, float *s, float *c)
+{
+    s[0] = m[0] * m[5] - m[4] * m[1];
+    s[1] = m[0] * m[6] - m[4] * m[2];
+    s[2] = m[0] * m[7] - m[4] * m[3];
+    s[3] = m[1] * m[6] - m[5] * m[2];
+    s[4] = m[1] * m[7] - m[5] * m[3];
+    s[5] = m[2] * m[7] - m[6] * m[3];
+
+    c[5] = m[10] * m[15] - m[14] * m[11];
+    c[4] = m[9] * m[15] - m[13] * m[11];
+    c[3] = m[9] * m[14] - m[13] * m[10];
+    c[2] = m[8] * m[15] - m[12] * m[11];
+    c[1] = m[8] * m[14] - m[12] * m[10];
+    c[0] = m[8] * m[13] - m[12] * m[9];
+}
+
+/** Determinant of a 4x4 matrix, stored by rows. */
+float inv_matrix_det4(const float *m)
+{
+    float s[6], c[6];
+
+    inv_matrix_minors4(m, s, c);
+    return s[0] * c[5] - s[1] * c[4] + s[2] * c[3] +
+        s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+}
+
+/** Inverse of a 4x4 matrix, stored by rows.
+ * @param[in] m Matrix
+ * @param[out] inv Inverse, must not be m
+ * @return INV_SUCCESS, or INV_ERROR_DIVIDE_BY_ZERO if m is singular.
+ */
+inv_error_t inv_matrix_inverse4(const float *m, float *inv)
+{
+    float s[6], c[6];
+    float det, r;
+
+    inv_matrix_minors4(m, s, c);
+    det = s[0] * c[5] - s[1] * c[4] + s[2] * c[3] +
+        s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+    if (det == 0)
+        return INV_ERROR_DIVIDE_BY_ZERO;
+    r = 1.0f / det;
+
+    inv[0] = (m[5] * c[5] - m[6] * c[4] + m[7] * c[3]) * r;
+    inv[1] = (-m[1] * c[5] + m[2] * c[4] - m[3] * c[3]) * r;
+    inv[2] = (m[13] * s[5] - m[14] * s[4] + m[15] * s[3]) * r;
+    inv[3] = (-m[9] * s[5] + m[10] * s[4] - m[11] * s[3]) * r;
+
+    inv[4] = (-m[4] * c[5] + m[6] * c[2] - m[7] * c[1]) * r;
+    inv[5] = (m[0] * c[5] - m[2] * c[2] + m[3] * c[1]) * r;
+    inv[6] = (-m[12] * s[5] + m[14] * s[2] - m[15] * s[1]) * r;
+    inv[7] = (m[8] * s[5] - m[10] * s[2] + m[11] * s[1]) * r;
+
+    inv[8] = (m[4] * c[4] - m[5] * c[2] + m[7] * c[0]) * r;
+    inv[9] = (-m[0] * c[4] + m[1] * c[2] - m[3] * c[0]) * r;
+    inv[10] = (m[12] * s[4] - m[13] * s[2] + m[15] * s[0]) * r;
+    inv[11] = (-m[8] * s[4] + m[9] * s[2] - m[11] * s[0]) * r;
+
+    inv[12] = (-m[4] * c[3] + m[5] * c[1] - m[6] * c[0]) * r;
+    inv[13] = (m[0] * c[3] - m[1] * c[1] + m[2] * c[0]) * r;
+    inv[14] = (-m[12] * s[3] + m[13] * s[1] - m[14] * s[0]) * r;
+    inv[15] = (m[8] * s[3] - m[9] * s[1] + m[10] * s[0]) * r;
+    return INV_SUCCESS;
+}
+
+/** LU decomposition with partial pivoting, in place.
+ * @param[in,out] a Matrix, replaced by L below the diagonal (the unit
+ *                diagonal of L is not stored) and U on and above it.
+ * @param[in] n Size of the matrix.
+ * @param[in] stride Distance between two rows of a, in elements.
+ * @param[out] perm Row of the input matrix now at each row of a.
+ * @return Sign of the row permutation, or 0 if the matrix is singular.
+ *         The determinant is the sign times the diagonal of a.
+ */
+int inv_matrix_lu(float *a, int n, int stride, int *perm)
+{
+    int sign = 1;
+    int i, j, k;
+
+    for (i = 0; i < n; i++)
+        perm[i] = i;
+
+    for (k = 0; k < n; k++) {
+        int pivot = k;
+        float max = fabsf(a[stride * k + k]);
+
+        for (i = k + 1; i < n; i++) {
+            if (fabsf(a[stride * i + k]) > max) {
+                max = fabsf(a[stride * i + k]);
+                pivot = i;
+            }
+        }
+        if (max == 0)
+            return 0;
+        if (pivot != k) {
+            int t = perm[k];
+            perm[k] = perm[pivot];
+            perm[pivot] = t;
+            for (j = 0; j < n; j++) {
+                float f = a[stride * k + j];
+                a[stride * k + j] = a[stride * pivot + j];
+                a[stride * pivot + j] = f;
+            }
+            sign = -sign;
+        }
+        for (i = k + 1; i < n; i++) {
+            float f = a[stride * i + k] / a[stride * k + k];
+            a[stride * i + k] = f;
+            for (j = k + 1; j < n; j++)
+                a[stride * i + j] -= f * a[stride * k + j];
+        }
+    }
+    return sign;
+}
+
+/** Solves a x = b from the LU decomposition of a.
+ * @param[in] lu Output of inv_matrix_lu()
+ * @param[in] n Size of the matrix.
+ * @param[in] stride Distance between two rows of lu, in elements.
+ * @param[in] perm Output of inv_matrix_lu()
+ * @param[in] b Right hand side
+ * @param[out] x Solution, must not be b
+ */
+void inv_matrix_lu_solve(const float *lu, int n, int stride, const int *perm,
+                         const float *b, float *x)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        float sum = b[perm[i]];
+        for (j = 0; j < i; j++)
+            sum -= lu[stride * i + j] * x[j];
+        x[i] = sum;
+    }
+    for (i = n - 1; i >= 0; i--) {
+        float sum = x[i];
+        for (j = i + 1; j < n; j++)
+            sum -= lu[stride * i + j] * x[j];
+        x[i] = sum / lu[stride * i + i];
+    }
 }
 
 /** Wraps angle from (-M_PI,M_PI]
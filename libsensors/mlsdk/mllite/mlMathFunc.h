@@ -18,6 +18,8 @@
 #ifndef INVENSENSE_INV_MATH_FUNC_H__
 #define INVENSENSE_INV_MATH_FUNC_H__
 
+#include "mltypes.h"
+
 #define SIGNM(k)((int)(k)&1?-1:1)
 
 #ifdef __cplusplus
@@ -34,6 +36,13 @@ extern "C" {
     unsigned char *inv_int16_to_big8(short x, unsigned char *big8);
     float inv_matrix_det(float *p, int *n);
     void inv_matrix_det_inc(float *a, float *b, int *n, int x, int y);
+    float inv_matrix_det3(const float *m);
+    float inv_matrix_det4(const float *m);
+    inv_error_t inv_matrix_inverse3(const float *m, float *inv);
+    inv_error_t inv_matrix_inverse4(const float *m, float *inv);
+    int inv_matrix_lu(float *a, int n, int stride, int *perm);
+    void inv_matrix_lu_solve(const float *lu, int n, int stride,
+                             const int *perm, const float *b, float *x);
     float inv_wrap_angle(float ang);
     float inv_angle_diff(float ang1, float ang2);
 
@@ -31,7 +31,9 @@
  *                Typically, these functions process stored calibration data.
  */
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ml_stored_data.h"
 #include "ml.h"
 #include "mlFIFO.h"
@@ -76,6 +78,30 @@ extern struct inv_obj_t inv_obj;
 #define STORECAL_LOG(...)
 #endif
 
+/* changes of the biases not worth a write of the calibration file */
+#define STORED_TEMP_TOL     (0.5f)      /* degrees C */
+#define STORED_GYRO_TOL     (0.05f)     /* dps */
+#define STORED_ACCEL_TOL    (328)       /* 5 mg, 1 g = 2^16 */
+#define STORED_COMPASS_TOL  (0.5f)      /* uT */
+
+/* the bias fields of the calibration last written or loaded */
+static struct {
+    int valid;
+    long temp_valid_data[BINS];
+    float temp_data[BINS][PTS_PER_BIN];
+    float x_gyro_temp_data[BINS][PTS_PER_BIN];
+    float y_gyro_temp_data[BINS][PTS_PER_BIN];
+    float z_gyro_temp_data[BINS][PTS_PER_BIN];
+    long accel_bias[3];
+    float compass_bias[3];
+    long got_compass_bias;
+    int got_init_compass_bias;
+    int compass_uncalibrated;
+    unsigned short compass_offset_valid;
+    long compass_offsets[3];
+    int compass_accuracy;
+} stored_cal;
+
 /**
  *  @brief  Duplicate of the inv_temp_comp_find_bin function in the libmpl
  *          advanced algorithms library. To remove cross-dependency, for now,
@@ -1506,6 +1532,115 @@ static inv_error_t inv_store_cal(unsigned char *calData, int length)
     return INV_SUCCESS;
 }
 
+/**
+ *  @internal
+ *  @brief  Keep the bias fields of the calibration data just written or
+ *          loaded, for inv_stored_cal_changed().
+ */
+static void inv_save_stored_cal(void)
+{
+    int i;
+
+    memcpy(stored_cal.temp_valid_data, inv_obj.temp_valid_data,
+           sizeof(stored_cal.temp_valid_data));
+    memcpy(stored_cal.temp_data, inv_obj.temp_data,
+           sizeof(stored_cal.temp_data));
+    memcpy(stored_cal.x_gyro_temp_data, inv_obj.x_gyro_temp_data,
+           sizeof(stored_cal.x_gyro_temp_data));
+    memcpy(stored_cal.y_gyro_temp_data, inv_obj.y_gyro_temp_data,
+           sizeof(stored_cal.y_gyro_temp_data));
+    memcpy(stored_cal.z_gyro_temp_data, inv_obj.z_gyro_temp_data,
+           sizeof(stored_cal.z_gyro_temp_data));
+    for (i = 0; i < 3; i++) {
+        stored_cal.accel_bias[i] = inv_obj.accel_bias[i];
+        stored_cal.compass_offsets[i] = inv_obj.compass_offsets[i];
+    }
+    if (inv_get_magnetometer_bias_float(stored_cal.compass_bias)) {
+        stored_cal.valid = FALSE;
+        return;
+    }
+    stored_cal.got_compass_bias = inv_obj.got_compass_bias;
+    stored_cal.got_init_compass_bias = inv_obj.got_init_compass_bias;
+    stored_cal.compass_uncalibrated =
+        inv_obj.compass_state == SF_UNCALIBRATED;
+    stored_cal.compass_offset_valid =
+        inv_obj.flags[INV_COMPASS_OFFSET_VALID];
+    stored_cal.compass_accuracy = inv_obj.compass_accuracy;
+    stored_cal.valid = TRUE;
+}
+
+static int inv_stored_cal_table_changed(float stored[BINS][PTS_PER_BIN],
+                                        float now[BINS][PTS_PER_BIN],
+                                        float tol)
+{
+    int i, j;
+
+    for (i = 0; i < BINS; i++) {
+        for (j = 0; j < PTS_PER_BIN; j++) {
+            if (fabsf(now[i][j] - stored[i][j]) > tol)
+                return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ *  @internal
+ *  @brief  Whether the calibration moved from the one last written or
+ *          loaded by more than the noise of its biases. The state of the
+ *          compass calibration and the number of points of the temperature
+ *          tables must match exactly; the bias values are compared within
+ *          the STORED_*_TOL tolerances. The fit state of the compass and
+ *          the next slot of the temperature tables are not compared, they
+ *          are written with the next change of the biases.
+ *  @return TRUE if the calibration file should be written.
+ */
+static int inv_stored_cal_changed(void)
+{
+    float compass_bias[3];
+    int i;
+
+    if (!stored_cal.valid)
+        return TRUE;
+
+    if (memcmp(stored_cal.temp_valid_data, inv_obj.temp_valid_data,
+               sizeof(stored_cal.temp_valid_data)))
+        return TRUE;
+    if (inv_stored_cal_table_changed(stored_cal.temp_data, inv_obj.temp_data,
+                                     STORED_TEMP_TOL) ||
+        inv_stored_cal_table_changed(stored_cal.x_gyro_temp_data,
+                                     inv_obj.x_gyro_temp_data,
+                                     STORED_GYRO_TOL) ||
+        inv_stored_cal_table_changed(stored_cal.y_gyro_temp_data,
+                                     inv_obj.y_gyro_temp_data,
+                                     STORED_GYRO_TOL) ||
+        inv_stored_cal_table_changed(stored_cal.z_gyro_temp_data,
+                                     inv_obj.z_gyro_temp_data,
+                                     STORED_GYRO_TOL))
+        return TRUE;
+
+    if (stored_cal.got_compass_bias != inv_obj.got_compass_bias ||
+        stored_cal.got_init_compass_bias != inv_obj.got_init_compass_bias ||
+        stored_cal.compass_uncalibrated !=
+            (inv_obj.compass_state == SF_UNCALIBRATED) ||
+        stored_cal.compass_offset_valid !=
+            inv_obj.flags[INV_COMPASS_OFFSET_VALID] ||
+        stored_cal.compass_accuracy != inv_obj.compass_accuracy)
+        return TRUE;
+
+    if (inv_get_magnetometer_bias_float(compass_bias))
+        return TRUE;
+    for (i = 0; i < 3; i++) {
+        if (labs(inv_obj.accel_bias[i] - stored_cal.accel_bias[i]) >
+                STORED_ACCEL_TOL ||
+            fabsf(compass_bias[i] - stored_cal.compass_bias[i]) >
+                STORED_COMPASS_TOL ||
+            inv_obj.compass_offsets[i] != stored_cal.compass_offsets[i])
+            return TRUE;
+    }
+    return FALSE;
+}
+
 /**
  *  @brief  Load a calibration file.
  *
@@ -1555,6 +1690,7 @@ inv_error_t inv_load_calibration(void)
         goto free_mem_n_exit;
 
     }
+    inv_save_stored_cal();
 
 
 
@@ -1582,6 +1718,12 @@ inv_error_t inv_store_calibration(void)
     if (inv_get_state() < INV_STATE_DMP_OPENED)
         return INV_ERROR_SM_IMPROPER_STATE;
 
+    if (!inv_stored_cal_changed()) {
+        MPL_LOGV("Calibration within the tolerances of the stored one - "
+                 "not written\n");
+        return INV_SUCCESS;
+    }
+
     length = inv_get_cal_length();
     calData = (unsigned char *)malloc(length);
     if (!calData) {
@@ -1602,12 +1744,11 @@ inv_error_t inv_store_calibration(void)
         goto free_mem_n_exit;
 
     }
-
-
+    inv_save_stored_cal();
 
 free_mem_n_exit:
     free(calData);
-    return INV_SUCCESS;
+    return result;
 }
 
 /**
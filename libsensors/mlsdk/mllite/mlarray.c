@@ -350,6 +350,101 @@ inv_error_t inv_get_magnetometer_float(float *data)
     return result;
 }
 
+/**
+ *  @brief  inv_get_gyro_bias_float is used to get the gyroscope bias removed
+ *          from the gyroscope measurement, rotated to the body frame.
+ *          The argument array elements are ordered X,Y,Z.
+ *          The values are in units of dps (degrees per second).
+ *
+ *  @pre    MLDmpOpen() \ifnot UMPL or MLDmpPedometerStandAloneOpen() \endif
+ *          must have been called.
+ *
+ *  @param  data
+ *              A pointer to an array to be passed back to the user.
+ *              <b>Must be 3 cells long</b>.
+ *
+ *  @return INV_SUCCESS if the command is successful; an error code otherwise.
+ */
+inv_error_t inv_get_gyro_bias_float(float *data)
+{
+    INVENSENSE_FUNC_START;
+
+    int i, j;
+
+    if (inv_get_state() < INV_STATE_DMP_OPENED)
+        return INV_ERROR_SM_IMPROPER_STATE;
+
+    if (NULL == data) {
+        return INV_ERROR_INVALID_PARAMETER;
+    }
+
+    /* gyro_bias is in dps * 2^16 in the chip frame */
+    for (i = 0; i < 3; i++) {
+        double bias = 0;
+        for (j = 0; j < 3; j++)
+            bias += (double)inv_obj.gyro_orient[i * 3 + j] *
+                inv_obj.gyro_bias[j];
+        data[i] = (float)(bias / (1LL << 46));
+    }
+
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  inv_get_magnetometer_bias_float is used to get the hard iron
+ *          bias removed from the magnetometer data, in the frame and the
+ *          scale of inv_get_magnetometer_float(), so that their sum is the
+ *          uncalibrated field.
+ *          The argument array elements are ordered X,Y,Z.
+ *          The values are in units of micro Tesla.
+ *
+ *  @pre    MLDmpOpen() \ifnot UMPL or MLDmpPedometerStandAloneOpen() \endif
+ *          must have been called.
+ *
+ *  @param  data
+ *              A pointer to an array to be passed back to the user.
+ *              <b>Must be 3 cells long</b>.
+ *
+ *  @return INV_SUCCESS if the command is successful; an error code otherwise.
+ */
+inv_error_t inv_get_magnetometer_bias_float(float *data)
+{
+    INVENSENSE_FUNC_START;
+
+    long long tmp[3];
+    int i, j;
+
+    if (inv_get_state() < INV_STATE_DMP_OPENED)
+        return INV_ERROR_SM_IMPROPER_STATE;
+
+    if (NULL == data) {
+        return INV_ERROR_INVALID_PARAMETER;
+    }
+
+    if (inv_obj.compass_sens == 0) {
+        data[0] = data[1] = data[2] = 0;
+        return INV_SUCCESS;
+    }
+
+    /* same steps as the calibration of the compass samples in
+       inv_accel_compass_supervisor(), applied to the offset of the first
+       sample plus the bias */
+    for (i = 0; i < 3; i++) {
+        tmp[i] = (long long)inv_obj.init_compass_bias[i] *
+            inv_obj.compass_sens / 16384;
+        tmp[i] += inv_obj.compass_bias[i];
+        tmp[i] = (tmp[i] * inv_obj.compass_scale[i]) / 65536L;
+    }
+    for (i = 0; i < 3; i++) {
+        long long tmp64 = 0;
+        for (j = 0; j < 3; j++)
+            tmp64 += tmp[j] * inv_obj.compass_cal[i * 3 + j];
+        data[i] = (float)(tmp64 / inv_obj.compass_sens) / 65536.0f;
+    }
+
+    return INV_SUCCESS;
+}
+
 /**
  * Returns the curren compass accuracy.
  *
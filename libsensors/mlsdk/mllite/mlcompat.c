@@ -91,22 +91,41 @@ void inv_matrix_det_incd(double *a, double *b, int *n, int x, int y)
     *n = *n - 1;
 }
 
+/* gaussian elimination with partial pivoting, rows 10 elements apart */
 double inv_matrix_detd(double *p, int *n)
 {
-    double d[10][10], sum = 0;
-    int i, j, m;
-    m = *n;
-    if (*n == 2)
-        return (*p ** (p + 11) - *(p + 1) ** (p + 10));
-    for (i = 0, j = 0; j < m; j++) {
-        *n = m;
-        inv_matrix_det_incd(p, &d[0][0], n, i, j);
-        sum =
-            sum + *(p + 10 * i + j) * SIGNM(i + j) * inv_matrix_detd(&d[0][0],
-                                                                     n);
+    double a[10][10], det = 1;
+    int i, j, k;
+    int m = *n;
+
+    for (i = 0; i < m; i++)
+        for (j = 0; j < m; j++)
+            a[i][j] = p[10 * i + j];
+
+    for (k = 0; k < m; k++) {
+        int pivot = k;
+        for (i = k + 1; i < m; i++)
+            if (fabs(a[i][k]) > fabs(a[pivot][k]))
+                pivot = i;
+        if (a[pivot][k] == 0)
+            return 0;
+        if (pivot != k) {
+            for (j = k; j < m; j++) {
+                double t = a[k][j];
+                a[k][j] = a[pivot][j];
+                a[pivot][j] = t;
+            }
+            det = -det;
+        }
+        det *= a[k][k];
+        for (i = k + 1; i < m; i++) {
+            double f = a[i][k] / a[k][k];
+            for (j = k + 1; j < m; j++)
+                a[i][j] -= f * a[k][j];
+        }
     }
 
-    return (sum);
+    return det;
 }
 
 
@@ -351,6 +351,8 @@ int inv_mpu_slave_read(struct mldl_cfg *mldl_cfg,
         LOG_RESULT_LOCATION(INV_ERROR_INVALID_PARAMETER);
         return INV_ERROR_INVALID_PARAMETER;
     }
+    inv_serial_trace(MLSL_TRACE_SLAVE_READ, slave->type, result,
+                     slave->read_len, data);
 
     return result;
 }
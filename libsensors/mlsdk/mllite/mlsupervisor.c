@@ -49,6 +49,8 @@
 #include "mlsl.h"
 #include "mlos.h"
 
+#include <string.h>
+
 #include <log.h>
 #undef MPL_LOG_TAG
 #define MPL_LOG_TAG "MPL-sup"
@@ -95,15 +97,14 @@ static int MLUpdateCompassCalibration3DOF(int command, long *data,
 {
     INVENSENSE_FUNC_START;
     int retValue = INV_SUCCESS;
-    static float m[10][10] = { {0} };
-    float mInv[10][10] = { {0} };
-    float mTmp[10][10] = { {0} };
+    static float m[4][4] = { {0} };
     static float xTransY[4] = { 0 };
+    float lu[4][4];
+    float x[4];
+    int perm[4];
     float magSqr = 0;
     float inpData[3] = { 0 };
     int i, j;
-    int a, b;
-    float d;
 
     switch (command) {
     case CAL_ADD_DATA:
@@ -135,27 +136,15 @@ static int MLUpdateCompassCalibration3DOF(int command, long *data,
         xTransY[3] += magSqr;
         break;
     case CAL_RUN:
-        a = 4;
-        b = a;
-        for (i = 0; i < b; i++) {
-            for (j = 0; j < b; j++) {
-                a = b;
-                inv_matrix_det_inc(&m[0][0], &mTmp[0][0], &a, i, j);
-                mInv[j][i] = SIGNM(i + j) * inv_matrix_det(&mTmp[0][0], &a);
-            }
-        }
-        a = b;
-        d = inv_matrix_det(&m[0][0], &a);
-        if (d == 0) {
+        /* solve the normal equations m x = xTransY of the sphere fit */
+        memcpy(lu, m, sizeof(lu));
+        if (!inv_matrix_lu(&lu[0][0], 4, 4, perm)) {
             return INV_ERROR;
         }
+        inv_matrix_lu_solve(&lu[0][0], 4, 4, perm, xTransY, x);
         for (i = 0; i < 3; i++) {
-            float tmp = 0;
-            for (j = 0; j < 4; j++) {
-                tmp += mInv[j][i] / d * xTransY[j];
-            }
             inv_obj.compass_test_bias[i] =
-                -(long)(tmp * inv_obj.compass_sens / 16384.0f);
+                -(long)(x[i] * inv_obj.compass_sens / 16384.0f);
         }
         break;
     case CAL_RESET:
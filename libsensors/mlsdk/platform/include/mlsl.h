@@ -233,6 +233,46 @@ inv_error_t inv_serial_write_cal(unsigned char *cal, unsigned int len);
  *  returns INV_SUCCESS if successful, a non-zero error code otherwise.
  */
 inv_error_t inv_serial_get_cal_length(unsigned int *len);
+
+/*
+ * Trace of the traffic with the MPU driver.
+ *
+ * When the debug.mpl.trace property names a file at inv_serial_open(),
+ * every transfer and interrupt is appended to it as a
+ * struct mlsl_trace_record followed by the length bytes read or written,
+ * so that a session can be replayed off the device.
+ */
+#define MLSL_TRACE_PROPERTY	"debug.mpl.trace"
+
+enum mlsl_trace_type {
+	MLSL_TRACE_WRITE = 1,
+	MLSL_TRACE_READ,
+	MLSL_TRACE_WRITE_MEM,
+	MLSL_TRACE_READ_MEM,
+	MLSL_TRACE_READ_FIFO,
+	MLSL_TRACE_SLAVE_READ,	/* address is the slave type */
+	MLSL_TRACE_IRQ,		/* address is the irq, data a mpuirq_data */
+};
+
+struct mlsl_trace_record {
+	unsigned long long timestamp;	/* CLOCK_MONOTONIC, ns */
+	int result;			/* returned by the driver */
+	unsigned short address;
+	unsigned short length;
+	unsigned char type;
+	unsigned char reserved[7];
+};
+
+/**
+ *  inv_serial_trace() - append a record to the trace, if one is open.
+ *  @type	one of enum mlsl_trace_type.
+ *  @address	register, memory address, slave type or irq.
+ *  @result	result of the transfer.
+ *  @length	length of data.
+ *  @data	data read or written, not recorded if the transfer failed.
+ */
+void inv_serial_trace(unsigned char type, unsigned short address, int result,
+		      unsigned short length, unsigned char const *data);
 #endif
 #ifdef __cplusplus
 }
@@ -35,6 +35,7 @@
 /* ------------- */
 
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <stdlib.h>
@@ -65,12 +66,13 @@ void inv_sleep(int mSecs)
  */
 unsigned long inv_get_tick_count()
 {
-    struct timeval tv;
+    struct timespec ts;
 
-    if (gettimeofday(&tv, NULL) !=0)
+    /* the wall clock can be set back, the MPL needs a monotonic tick */
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
         return 0;
 
-    return (long)((tv.tv_sec * 1000000LL + tv.tv_usec) / 1000LL);
+    return (long)(ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL);
 }
 
   /**********************/
@@ -45,6 +45,10 @@
 #include <string.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include <cutils/properties.h>
 
 #include "mpu.h"
 #include "mpu3050.h"
@@ -55,7 +59,9 @@
 #include "mlinclude.h"
 
 #define MLCAL_ID      (0x0A0B0C0DL)
-#define MLCAL_FILE    "/data/cal.bin"
+#define MLCAL_DIR     "/data"
+#define MLCAL_FILE    MLCAL_DIR "/cal.bin"
+#define MLCAL_TMP     MLCAL_DIR "/cal.bin.tmp"
 #define MLCFG_ID      (0x01020304L)
 #define MLCFG_FILE    "/data/cfg.bin"
 
@@ -81,16 +87,174 @@
 /* - Global and Static vars. - */
 /* --------------------------- */
 
+/* trace of the driver traffic, see MLSL_TRACE_PROPERTY */
+static int trace_fd = -1;
+
+/* the calibration file is written by a background thread, so that the
+   sensor thread does not wait on the flash */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int started;
+    int busy;                   /* a write is queued or in progress */
+    unsigned char *pending;     /* next data to write */
+    unsigned int pending_len;
+    unsigned char *current;     /* data of the file */
+    unsigned int current_len;
+} cal_writer = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, NULL, 0, NULL, 0
+};
+
 /* ---------------- */
 /* - Definitions. - */
 /* ---------------- */
 
+static void inv_serial_trace_open(void)
+{
+    char path[PROPERTY_VALUE_MAX];
+
+    if (trace_fd >= 0 || property_get(MLSL_TRACE_PROPERTY, path, "") <= 0)
+        return;
+
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    if (trace_fd < 0)
+        MPL_LOGE("Cannot open trace file \"%s\": %d\n", path, errno);
+    else
+        MPL_LOGI("tracing the driver traffic to %s\n", path);
+}
+
+void inv_serial_trace(unsigned char type, unsigned short address, int result,
+                      unsigned short length, unsigned char const *data)
+{
+    struct mlsl_trace_record rec;
+    struct iovec iov[2];
+    struct timespec ts;
+
+    if (trace_fd < 0)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    memset(&rec, 0, sizeof(rec));
+    rec.timestamp = (unsigned long long)ts.tv_sec * 1000000000ULL +
+        ts.tv_nsec;
+    rec.result = result;
+    rec.address = address;
+    rec.length = (result == INV_SUCCESS && data) ? length : 0;
+    rec.type = type;
+
+    /* one writev per record, so a record is never split in the file */
+    iov[0].iov_base = &rec;
+    iov[0].iov_len = sizeof(rec);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = rec.length;
+    if (writev(trace_fd, iov, rec.length ? 2 : 1) < 0) {
+        MPL_LOGE("trace write failed (%d), tracing stopped\n", errno);
+        close(trace_fd);
+        trace_fd = -1;
+    }
+}
+
+
+/* remember the data of the file, to skip the writes that would not change it.
+   must be called with the cal_writer lock held. */
+static void cal_writer_set_current(unsigned char *cal, unsigned int len)
+{
+    free(cal_writer.current);
+    cal_writer.current = cal;
+    cal_writer.current_len = len;
+}
+
+/* wait until the file holds the last data given to inv_serial_write_cal() */
+static void cal_writer_wait(void)
+{
+    pthread_mutex_lock(&cal_writer.lock);
+    while (cal_writer.busy)
+        pthread_cond_wait(&cal_writer.cond, &cal_writer.lock);
+    pthread_mutex_unlock(&cal_writer.lock);
+}
+
+/* replace the calibration file without ever leaving a partial one behind */
+static inv_error_t cal_write_file(const unsigned char *cal, unsigned int len)
+{
+    unsigned int written = 0;
+    int fd;
+
+    fd = open(MLCAL_TMP, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+    if (fd < 0) {
+        MPL_LOGE("Cannot open file \"%s\" for write\n", MLCAL_TMP);
+        return INV_ERROR_FILE_OPEN;
+    }
+    while (written < len) {
+        ssize_t n = write(fd, cal + written, len - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            MPL_LOGE("bytes written (%d) don't match requested length (%d)\n",
+                     written, len);
+            close(fd);
+            unlink(MLCAL_TMP);
+            return INV_ERROR_FILE_WRITE;
+        }
+        written += n;
+    }
+    if (fsync(fd) || close(fd)) {
+        MPL_LOGE("Cannot sync file \"%s\": %d\n", MLCAL_TMP, errno);
+        unlink(MLCAL_TMP);
+        return INV_ERROR_FILE_WRITE;
+    }
+    if (rename(MLCAL_TMP, MLCAL_FILE)) {
+        MPL_LOGE("Cannot rename \"%s\": %d\n", MLCAL_TMP, errno);
+        unlink(MLCAL_TMP);
+        return INV_ERROR_FILE_WRITE;
+    }
+
+    /* make the rename itself durable */
+    fd = open(MLCAL_DIR, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return INV_SUCCESS;
+}
+
+static void *cal_writer_thread(void *arg __unused)
+{
+    pthread_mutex_lock(&cal_writer.lock);
+    for (;;) {
+        unsigned char *cal;
+        unsigned int len;
+
+        while (!cal_writer.pending)
+            pthread_cond_wait(&cal_writer.cond, &cal_writer.lock);
+        cal = cal_writer.pending;
+        len = cal_writer.pending_len;
+        cal_writer.pending = NULL;
+        pthread_mutex_unlock(&cal_writer.lock);
+
+        if (cal_write_file(cal, len) == INV_SUCCESS) {
+            pthread_mutex_lock(&cal_writer.lock);
+            cal_writer_set_current(cal, len);
+        } else {
+            free(cal);
+            pthread_mutex_lock(&cal_writer.lock);
+        }
+
+        if (!cal_writer.pending) {
+            cal_writer.busy = 0;
+            pthread_cond_broadcast(&cal_writer.cond);
+        }
+    }
+    return NULL;
+}
+
 inv_error_t inv_serial_read_cal(unsigned char *cal, unsigned int len)
 {
     FILE *fp;
     unsigned int bytesRead;
     inv_error_t result = INV_SUCCESS;
 
+    cal_writer_wait();
+
     fp = fopen(MLCAL_FILE,"rb");
     if (fp == NULL) {
         MPL_LOGE("Cannot open file \"%s\" for read\n", MLCAL_FILE);
@@ -104,6 +268,15 @@ inv_error_t inv_serial_read_cal(unsigned char *cal, unsigned int len)
         goto read_cal_end;
     }
 
+    pthread_mutex_lock(&cal_writer.lock);
+    if (!cal_writer.busy) {
+        unsigned char *copy = (unsigned char *)malloc(len);
+        if (copy)
+            memcpy(copy, cal, len);
+        cal_writer_set_current(copy, copy ? len : 0);
+    }
+    pthread_mutex_unlock(&cal_writer.lock);
+
     /* MLCAL_ID not used
     if (((unsigned int)cal[0] << 24 | cal[1] << 16 | cal[2] << 8 | cal[3])
         != MLCAL_ID) {
@@ -116,25 +289,63 @@ read_cal_end:
     return result;
 }
 
+/* the data is copied and written by the background thread. A write that
+   would not change the file is skipped. */
 inv_error_t inv_serial_write_cal(unsigned char *cal, unsigned int len)
 {
-    FILE *fp;
-    unsigned int bytesWritten;
-    inv_error_t result = INV_SUCCESS;
+    const unsigned char *last;
+    unsigned int last_len;
+    unsigned char *copy;
+
+    pthread_mutex_lock(&cal_writer.lock);
+    last = cal_writer.pending ? cal_writer.pending : cal_writer.current;
+    last_len = cal_writer.pending ? cal_writer.pending_len :
+        cal_writer.current_len;
+    if (last && last_len == len && !memcmp(last, cal, len)) {
+        pthread_mutex_unlock(&cal_writer.lock);
+        MPL_LOGV("calibration unchanged, not written\n");
+        return INV_SUCCESS;
+    }
 
-    fp = fopen(MLCAL_FILE,"wb");
-    if (fp == NULL) {
-        MPL_LOGE("Cannot open file \"%s\" for write\n", MLCAL_FILE);
-        return INV_ERROR_FILE_OPEN;
+    copy = (unsigned char *)malloc(len);
+    if (!copy) {
+        pthread_mutex_unlock(&cal_writer.lock);
+        return INV_ERROR_MEMORY_EXAUSTED;
     }
-    bytesWritten = fwrite(cal, 1, len, fp);
-    if (bytesWritten != len) {
-        MPL_LOGE("bytes written (%d) don't match requested length (%d)\n",
-                 bytesWritten, len);
-        result = INV_ERROR_FILE_WRITE;
+    memcpy(copy, cal, len);
+
+    if (!cal_writer.started) {
+        pthread_t thread;
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        cal_writer.started =
+            !pthread_create(&thread, &attr, cal_writer_thread, NULL);
+        pthread_attr_destroy(&attr);
     }
-    fclose(fp);
-    return result;
+    if (!cal_writer.started) {
+        /* no thread, write in place */
+        inv_error_t result;
+
+        MPL_LOGW("no calibration writer thread, writing synchronously\n");
+        result = cal_write_file(copy, len);
+        if (result == INV_SUCCESS)
+            cal_writer_set_current(copy, len);
+        else
+            free(copy);
+        pthread_mutex_unlock(&cal_writer.lock);
+        return result;
+    }
+
+    /* only the last data matters, drop the one not written yet */
+    free(cal_writer.pending);
+    cal_writer.pending = copy;
+    cal_writer.pending_len = len;
+    cal_writer.busy = 1;
+    pthread_cond_broadcast(&cal_writer.cond);
+    pthread_mutex_unlock(&cal_writer.lock);
+    return INV_SUCCESS;
 }
 
 inv_error_t inv_serial_get_cal_length(unsigned int *len)
@@ -142,6 +353,8 @@ inv_error_t inv_serial_get_cal_length(unsigned int *len)
     FILE *calFile;
     *len = 0;
 
+    cal_writer_wait();
+
     calFile = fopen(MLCAL_FILE, "rb");
     if (calFile == NULL) {
         MPL_LOGE("Cannot open file \"%s\" for read\n", MLCAL_FILE);
@@ -178,6 +391,8 @@ inv_error_t inv_serial_open(char const *port, void **sl_handle)
         MPL_LOGI("inv_serial_open: %s\n", port);
     }
 
+    inv_serial_trace_open();
+
     return INV_SUCCESS;
 }
 
@@ -187,6 +402,11 @@ inv_error_t inv_serial_close(void *sl_handle)
 
     close((int)(uintptr_t)sl_handle);
 
+    if (trace_fd >= 0) {
+        close(trace_fd);
+        trace_fd = -1;
+    }
+
     return INV_SUCCESS;
 }
 
@@ -218,7 +438,9 @@ inv_error_t inv_serial_write(void *sl_handle,
     msg.length  = length;
     msg.data    = (unsigned char*)data;
 
-    if ((result = ioctl((int)(uintptr_t)sl_handle, MPU_WRITE, &msg))) {
+    result = ioctl((int)(uintptr_t)sl_handle, MPU_WRITE, &msg);
+    inv_serial_trace(MLSL_TRACE_WRITE, data[0], result, length, data);
+    if (result) {
         MPL_LOGE("I2C Error: could not write: R:%02x L:%d %d \n",
                  data[0], length, result);
        return result;
@@ -256,6 +478,7 @@ inv_error_t inv_serial_read(void *sl_handle,
     msg.data    = data;
 
     result = ioctl((int)(uintptr_t)sl_handle, MPU_READ, &msg);
+    inv_serial_trace(MLSL_TRACE_READ, registerAddr, result, length, data);
 
     if (result != INV_SUCCESS) {
         MPL_LOGE("I2C Error %08x: could not read: R:%02x L:%d\n",
@@ -291,6 +514,7 @@ inv_error_t inv_serial_write_mem(void *sl_handle,
     msg.data    = (unsigned char *)data;
 
     result = ioctl((int)(uintptr_t)sl_handle, MPU_WRITE_MEM, &msg);
+    inv_serial_trace(MLSL_TRACE_WRITE_MEM, memAddr, result, length, data);
     if (result) {
         LOG_RESULT_LOCATION(result);
         return result;
@@ -327,6 +551,7 @@ inv_error_t inv_serial_read_mem(void *sl_handle,
     msg.data    = data;
 
     result = ioctl((int)(uintptr_t)sl_handle, MPU_READ_MEM, &msg);
+    inv_serial_trace(MLSL_TRACE_READ_MEM, memAddr, result, length, data);
     if (result != INV_SUCCESS) {
         MPL_LOGE("I2C Error %08x: could not read memory: A:%04x L:%d\n",
                  result, memAddr, length);
@@ -363,6 +588,8 @@ inv_error_t inv_serial_read_fifo(void *sl_handle,
     msg.data    = data;
 
     result = ioctl((int)(uintptr_t)sl_handle, MPU_READ_FIFO, &msg);
+    inv_serial_trace(MLSL_TRACE_READ_FIFO, MPUREG_FIFO_R_W, result, length,
+                     data);
     if (result != INV_SUCCESS) {
         MPL_LOGE("I2C Error %08x: could not read fifo: R:%02x L:%d\n",
                  result, MPUREG_FIFO_R_W, length);
@@ -25,6 +25,9 @@
 #define SENSORS_ACCELERATION_HANDLE     (ID_A)
 #define SENSORS_MAGNETIC_FIELD_HANDLE   (ID_M)
 #define SENSORS_ORIENTATION_HANDLE      (ID_O)
+#define SENSORS_GYROSCOPE_UNCALIBRATED_HANDLE       (ID_GYU)
+#define SENSORS_MAGNETIC_FIELD_UNCALIBRATED_HANDLE  (ID_MU)
+#define SENSORS_GAME_ROTATION_VECTOR_HANDLE         (ID_GRV)
 /******************************************/
 //COMPASS_ID_YAS530
 #define COMPASS_YAS530_RANGE        (8001.0f)
@@ -62,6 +65,14 @@
 #define NINEAXIS_LINEAR_ACCEL_RANGE      (ACCEL_BMA250_RANGE)
 #define NINEAXIS_LINEAR_ACCEL_RESOLUTION (ACCEL_BMA250_RESOLUTION)
 #define NINEAXIS_LINEAR_ACCEL_POWER      (NINEAXIS_POWER)
+/******************************************/
+//SIXAXIS, the DMP attitude without the compass
+#define SIXAXIS_POWER (ACCEL_BMA250_POWER + \
+                       GYRO_MPU3050_POWER)
+
+#define SIXAXIS_GAME_ROTATION_VECTOR_RANGE      (1.0f)
+#define SIXAXIS_GAME_ROTATION_VECTOR_RESOLUTION (0.00001f)
+#define SIXAXIS_GAME_ROTATION_VECTOR_POWER      (SIXAXIS_POWER)
 
 #endif
 
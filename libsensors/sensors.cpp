@@ -24,14 +24,17 @@
 #include <errno.h>
 #include <dirent.h>
 #include <math.h>
-#include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include <linux/input.h>
 
 #include <utils/Atomic.h>
 #include <utils/Log.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 #include "sensors.h"
 #include "sensor_params.h"
@@ -56,6 +59,9 @@
 #define SENSORS_ACCELERATION     (1<<ID_A)
 #define SENSORS_MAGNETIC_FIELD   (1<<ID_M)
 #define SENSORS_ORIENTATION      (1<<ID_O)
+#define SENSORS_GYROSCOPE_UNCALIBRATED      (1<<ID_GYU)
+#define SENSORS_MAGNETIC_FIELD_UNCALIBRATED (1<<ID_MU)
+#define SENSORS_GAME_ROTATION_VECTOR        (1<<ID_GRV)
 #define SENSORS_LIGHT            (1<<ID_L)
 #define SENSORS_PROXIMITY        (1<<ID_P)
 #define SENSORS_PRESSURE         (1<<ID_PR)
@@ -68,6 +74,9 @@
 #define SENSORS_ACCELERATION_HANDLE     (ID_A)
 #define SENSORS_MAGNETIC_FIELD_HANDLE   (ID_M)
 #define SENSORS_ORIENTATION_HANDLE      (ID_O)
+#define SENSORS_GYROSCOPE_UNCALIBRATED_HANDLE       (ID_GYU)
+#define SENSORS_MAGNETIC_FIELD_UNCALIBRATED_HANDLE  (ID_MU)
+#define SENSORS_GAME_ROTATION_VECTOR_HANDLE         (ID_GRV)
 #define SENSORS_LIGHT_HANDLE            (ID_L)
 #define SENSORS_PROXIMITY_HANDLE        (ID_P)
 #define SENSORS_PRESSURE_HANDLE         (ID_PR)
@@ -93,7 +102,7 @@ static struct sensor_t sSensorList[LOCAL_SENSORS + MPLSensor::numSensors] =
      SENSOR_STRING_TYPE_AMBIENT_TEMPERATURE, "", 20000, SENSOR_FLAG_CONTINUOUS_MODE, {}},
     {"MPL Gyroscope", "Invensense", 1, SENSORS_GYROSCOPE_HANDLE,
      SENSOR_TYPE_GYROSCOPE, GYRO_MPU3050_RANGE, GYRO_MPU3050_RESOLUTION,
-     GYRO_MPU3050_POWER, 10000, 0, 0, SENSOR_STRING_TYPE_GYROSCOPE, "",
+     GYRO_MPU3050_POWER, 5000, 0, 0, SENSOR_STRING_TYPE_GYROSCOPE, "",
      0, SENSOR_FLAG_CONTINUOUS_MODE, {}},
     {"MPL Accelerometer", "Invensense", 1, SENSORS_ACCELERATION_HANDLE,
      SENSOR_TYPE_ACCELEROMETER, ACCEL_BMA250_RANGE, ACCEL_BMA250_RESOLUTION,
@@ -119,6 +128,18 @@ static struct sensor_t sSensorList[LOCAL_SENSORS + MPLSensor::numSensors] =
      SENSOR_TYPE_GRAVITY, NINEAXIS_GRAVITY_RANGE, NINEAXIS_GRAVITY_RESOLUTION,
      NINEAXIS_GRAVITY_POWER, 10000, 0, 0, SENSOR_STRING_TYPE_GRAVITY, "",
      0, SENSOR_FLAG_CONTINUOUS_MODE, {}},
+    {"MPL Gyroscope Uncalibrated", "Invensense", 1, SENSORS_GYROSCOPE_UNCALIBRATED_HANDLE,
+     SENSOR_TYPE_GYROSCOPE_UNCALIBRATED, GYRO_MPU3050_RANGE, GYRO_MPU3050_RESOLUTION,
+     GYRO_MPU3050_POWER, 5000, 0, 0, SENSOR_STRING_TYPE_GYROSCOPE_UNCALIBRATED, "",
+     0, SENSOR_FLAG_CONTINUOUS_MODE, {}},
+    {"MPL Magnetic Field Uncalibrated", "Invensense", 1, SENSORS_MAGNETIC_FIELD_UNCALIBRATED_HANDLE,
+     SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED, COMPASS_YAS530_RANGE, COMPASS_YAS530_RESOLUTION,
+     COMPASS_YAS530_POWER, 10000, 0, 0, SENSOR_STRING_TYPE_MAGNETIC_FIELD_UNCALIBRATED, "",
+     0, SENSOR_FLAG_CONTINUOUS_MODE, {}},
+    {"MPL Game Rotation Vector", "Invensense", 1, SENSORS_GAME_ROTATION_VECTOR_HANDLE,
+     SENSOR_TYPE_GAME_ROTATION_VECTOR, SIXAXIS_GAME_ROTATION_VECTOR_RANGE, SIXAXIS_GAME_ROTATION_VECTOR_RESOLUTION,
+     SIXAXIS_GAME_ROTATION_VECTOR_POWER, 5000, 0, 0, SENSOR_STRING_TYPE_GAME_ROTATION_VECTOR, "",
+     0, SENSOR_FLAG_CONTINUOUS_MODE, {}},
 };
 static int numSensors = LOCAL_SENSORS;
 
@@ -161,12 +182,14 @@ struct sensors_module_t HAL_MODULE_INFO_SYM = {
 };
 
 struct sensors_poll_context_t {
-    struct sensors_poll_device_t device; // must be first
+    struct sensors_poll_device_1 device; // must be first
 
         sensors_poll_context_t();
         ~sensors_poll_context_t();
     int activate(int handle, int enabled);
     int setDelay(int handle, int64_t ns);
+    int batch(int handle, int flags, int64_t period_ns, int64_t timeout);
+    int flush(int handle);
     int pollEvents(sensors_event_t* data, int count);
 
 private:
@@ -178,17 +201,25 @@ private:
         proximity,
         pressure,
         temperature,
-        numSensorDrivers,       // wake pipe goes here
+        numSensorDrivers,       // wake eventfd goes here
         mpl_power,              //special handle for MPL pm interaction
         numFds,
     };
 
     static const size_t wake = numFds - 2;
-    static const char WAKE_MESSAGE = 'W';
-    struct pollfd mPollFds[numFds];
-    int mWritePipeFd;
+    int mEpollFd;
+    int mWakeFd;
+    uint32_t mReadyDrivers;     // drivers which may still have data to read
     SensorBase* mSensors[numSensorDrivers];
 
+    /* flush complete events of the drivers without an event queue */
+    pthread_mutex_t mFlushLock;
+    android::Vector<int> mFlushedHandles;
+
+    void wakePoll();
+    void addFd(int fd, int index);
+    int readFlushEvents(sensors_event_t* data, int count);
+
     int handleToDriver(int handle) const {
         switch (handle) {
             case ID_RV:
@@ -198,6 +229,9 @@ private:
             case ID_A:
             case ID_M:
             case ID_O:
+            case ID_GYU:
+            case ID_MU:
+            case ID_GRV:
                 return mpl;
             case ID_L:
                 return light;
@@ -217,6 +251,12 @@ private:
 sensors_poll_context_t::sensors_poll_context_t()
 {
     FUNC_LOG;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    pthread_mutex_init(&mFlushLock, NULL);
+
+    SensorBase::scanInputs();
+
     MPLSensor* p_mplsen = new MPLSensor();
     setCallbackObject(p_mplsen); //setup the callback object for handing mpl callbacks
     numSensors =
@@ -225,55 +265,36 @@ sensors_poll_context_t::sensors_poll_context_t()
                                      sizeof(sSensorList[0]) * (ARRAY_SIZE(sSensorList) - LOCAL_SENSORS));
 
     mSensors[mpl] = p_mplsen;
-    mPollFds[mpl].fd = mSensors[mpl]->getFd();
-    mPollFds[mpl].events = POLLIN;
-    mPollFds[mpl].revents = 0;
-
     mSensors[mpl_accel] = mSensors[mpl];
-    mPollFds[mpl_accel].fd = ((MPLSensor*)mSensors[mpl])->getAccelFd();
-    mPollFds[mpl_accel].events = POLLIN;
-    mPollFds[mpl_accel].revents = 0;
-
     mSensors[mpl_timer] = mSensors[mpl];
-    mPollFds[mpl_timer].fd = ((MPLSensor*)mSensors[mpl])->getTimerFd();
-    mPollFds[mpl_timer].events = POLLIN;
-    mPollFds[mpl_timer].revents = 0;
-
     mSensors[light] = new LightSensor();
-    mPollFds[light].fd = mSensors[light]->getFd();
-    mPollFds[light].events = POLLIN;
-    mPollFds[light].revents = 0;
-
     mSensors[proximity] = new ProximitySensor();
-    mPollFds[proximity].fd = mSensors[proximity]->getFd();
-    mPollFds[proximity].events = POLLIN;
-    mPollFds[proximity].revents = 0;
-
     mSensors[pressure] = new PressureSensor();
-    mPollFds[pressure].fd = mSensors[pressure]->getFd();
-    mPollFds[pressure].events = POLLIN;
-    mPollFds[pressure].revents = 0;
-
     mSensors[temperature] = new TemperatureSensor();
-    mPollFds[temperature].fd = mSensors[temperature]->getFd();
-    mPollFds[temperature].events = POLLIN;
-    mPollFds[temperature].revents = 0;
+    mReadyDrivers = 0;
+
+    SensorBase::releaseInputs();
 
-    int wakeFds[2];
-    int result = pipe(wakeFds);
-    ALOGE_IF(result<0, "error creating wake pipe (%s)", strerror(errno));
-    fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
-    fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
-    mWritePipeFd = wakeFds[1];
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    ALOGE_IF(mEpollFd < 0, "error creating epoll fd (%s)", strerror(errno));
 
-    mPollFds[wake].fd = wakeFds[0];
-    mPollFds[wake].events = POLLIN;
-    mPollFds[wake].revents = 0;
+    mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ALOGE_IF(mWakeFd < 0, "error creating wake eventfd (%s)", strerror(errno));
+
+    addFd(mSensors[mpl]->getFd(), mpl);
+    addFd(((MPLSensor*)mSensors[mpl])->getAccelFd(), mpl_accel);
+    addFd(((MPLSensor*)mSensors[mpl])->getTimerFd(), mpl_timer);
+    addFd(mSensors[light]->getFd(), light);
+    addFd(mSensors[proximity]->getFd(), proximity);
+    addFd(mSensors[pressure]->getFd(), pressure);
+    addFd(mSensors[temperature]->getFd(), temperature);
+    addFd(mWakeFd, wake);
 
     //setup MPL pm interaction handle
-    mPollFds[mpl_power].fd = ((MPLSensor*)mSensors[mpl])->getPowerFd();
-    mPollFds[mpl_power].events = POLLIN;
-    mPollFds[mpl_power].revents = 0;
+    addFd(((MPLSensor*)mSensors[mpl])->getPowerFd(), mpl_power);
+
+    ALOGI("sensor HAL started in %lld us",
+          (long long)ns2us(systemTime(SYSTEM_TIME_MONOTONIC) - start));
 }
 
 sensors_poll_context_t::~sensors_poll_context_t()
@@ -282,8 +303,29 @@ sensors_poll_context_t::~sensors_poll_context_t()
     for (int i = 0; i < numSensorDrivers; i++) {
         delete mSensors[i];
     }
-    close(mPollFds[wake].fd);
-    close(mWritePipeFd);
+    close(mEpollFd);
+    close(mWakeFd);
+    pthread_mutex_destroy(&mFlushLock);
+}
+
+void sensors_poll_context_t::addFd(int fd, int index)
+{
+    struct epoll_event ev;
+
+    if (fd < 0)
+        return;
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = index;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        ALOGE("error adding fd %d to epoll (%s)", fd, strerror(errno));
+}
+
+void sensors_poll_context_t::wakePoll()
+{
+    uint64_t wakeCount = 1;
+    int result = write(mWakeFd, &wakeCount, sizeof(wakeCount));
+    ALOGE_IF(result < 0, "error sending wake event (%s)", strerror(errno));
 }
 
 int sensors_poll_context_t::activate(int handle, int enabled)
@@ -292,11 +334,8 @@ int sensors_poll_context_t::activate(int handle, int enabled)
     int index = handleToDriver(handle);
     if (index < 0) return index;
     int err =  mSensors[index]->enable(handle, enabled);
-    if (!err) {
-        const char wakeMessage(WAKE_MESSAGE);
-        int result = write(mWritePipeFd, &wakeMessage, 1);
-        ALOGE_IF(result < 0, "error sending wake message (%s)", strerror(errno));
-    }
+    if (!err)
+        wakePoll();
     return err;
 }
 
@@ -308,36 +347,84 @@ int sensors_poll_context_t::setDelay(int handle, int64_t ns)
     return mSensors[index]->setDelay(handle, ns);
 }
 
+int sensors_poll_context_t::batch(int handle, int flags, int64_t period_ns,
+                                  int64_t timeout)
+{
+    FUNC_LOG;
+    int index = handleToDriver(handle);
+    if (index < 0) return index;
+    return mSensors[index]->batch(handle, flags, period_ns, timeout);
+}
+
+int sensors_poll_context_t::flush(int handle)
+{
+    FUNC_LOG;
+    int index = handleToDriver(handle);
+    if (index < 0) return index;
+    int err = mSensors[index]->flush(handle);
+    if (err == -ENOSYS) {
+        // nothing is queued in the driver, the flush completes right away
+        pthread_mutex_lock(&mFlushLock);
+        mFlushedHandles.push(handle);
+        pthread_mutex_unlock(&mFlushLock);
+        err = 0;
+    }
+    if (!err)
+        wakePoll();
+    return err;
+}
+
+int sensors_poll_context_t::readFlushEvents(sensors_event_t* data, int count)
+{
+    int nb = 0;
+
+    pthread_mutex_lock(&mFlushLock);
+    while (count && !mFlushedHandles.isEmpty()) {
+        memset(data, 0, sizeof(*data));
+        data->version = META_DATA_VERSION;
+        data->type = SENSOR_TYPE_META_DATA;
+        data->meta_data.what = META_DATA_FLUSH_COMPLETE;
+        data->meta_data.sensor = mFlushedHandles[0];
+        mFlushedHandles.removeAt(0);
+        data++;
+        count--;
+        nb++;
+    }
+    pthread_mutex_unlock(&mFlushLock);
+
+    return nb;
+}
+
 int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 {
     //FUNC_LOG;
+    struct epoll_event events[numFds];
     int nbEvents = 0;
     int n = 0;
     int polltime = -1;
 
     do {
-        // see if we have some leftover from the last poll()
+        int flushed = readFlushEvents(data, count);
+        count -= flushed;
+        nbEvents += flushed;
+        data += flushed;
+
+        // read the drivers which were ready or have some leftover
+        // from the last epoll_wait()
         for (int i = 0; count && i < numSensorDrivers; i++) {
+            // the mpl accel and timer fds are read by the mpl driver
+            if (i == mpl_accel || i == mpl_timer)
+                continue;
             SensorBase* const sensor(mSensors[i]);
-            if ((mPollFds[i].revents & POLLIN) || (sensor->hasPendingEvents())) {
+            if ((mReadyDrivers & (1 << i)) || sensor->hasPendingEvents()) {
                 int nb = sensor->readEvents(data, count);
                 if (nb < count) {
                     // no more data for this sensor
-                    mPollFds[i].revents = 0;
+                    mReadyDrivers &= ~(1 << i);
                 }
                 count -= nb;
                 nbEvents += nb;
                 data += nb;
-
-                //special handling for the mpl, which has multiple handles
-                if (i == mpl) {
-                    i += 2; //skip accel and timer
-                    mPollFds[mpl_accel].revents = 0;
-                    mPollFds[mpl_timer].revents = 0;
-                } else if (i == mpl_accel) {
-                    i += 1; //skip timer
-                    mPollFds[mpl_timer].revents = 0;
-                }
             }
         }
 
@@ -346,22 +433,26 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
             // some events immediately or just wait if we don't have
             // anything to return
             do {
-                n = poll(mPollFds, numFds, nbEvents ? 0 : polltime);
+                n = epoll_wait(mEpollFd, events, numFds, nbEvents ? 0 : polltime);
             } while (n < 0 && errno == EINTR);
             if (n < 0) {
-                ALOGE("poll() failed (%s)", strerror(errno));
+                ALOGE("epoll_wait() failed (%s)", strerror(errno));
                 return -errno;
             }
-            if (mPollFds[wake].revents & POLLIN) {
-                char msg;
-                int result = read(mPollFds[wake].fd, &msg, 1);
-                ALOGE_IF(result < 0, "error reading from wake pipe (%s)", strerror(errno));
-                ALOGE_IF(msg != WAKE_MESSAGE, "unknown message on wake queue (0x%02x)", int(msg));
-                mPollFds[wake].revents = 0;
-            }
-            if (mPollFds[mpl_power].revents & POLLIN) {
-                ((MPLSensor*)mSensors[mpl])->handlePowerEvent();
-                mPollFds[mpl_power].revents = 0;
+            for (int i = 0; i < n; i++) {
+                uint32_t index = events[i].data.u32;
+
+                if (index == wake) {
+                    uint64_t wakeCount;
+                    int result = read(mWakeFd, &wakeCount, sizeof(wakeCount));
+                    ALOGE_IF(result < 0, "error reading wake event (%s)", strerror(errno));
+                } else if (index == mpl_power) {
+                    ((MPLSensor*)mSensors[mpl])->handlePowerEvent();
+                } else if (index == mpl_accel || index == mpl_timer) {
+                    mReadyDrivers |= (1 << mpl);
+                } else {
+                    mReadyDrivers |= (1 << index);
+                }
             }
         }
         // if we have events and space, go read them
@@ -406,6 +497,21 @@ static int poll__poll(struct sensors_poll_device_t *dev,
     return ctx->pollEvents(data, count);
 }
 
+static int poll__batch(struct sensors_poll_device_1 *dev,
+                       int handle, int flags, int64_t period_ns, int64_t timeout)
+{
+    FUNC_LOG;
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->batch(handle, flags, period_ns, timeout);
+}
+
+static int poll__flush(struct sensors_poll_device_1 *dev, int handle)
+{
+    FUNC_LOG;
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->flush(handle);
+}
+
 /*****************************************************************************/
 
 /** Open a new instance of a sensor device using name */
@@ -417,16 +523,17 @@ static int open_sensors(const struct hw_module_t* module,
     int status = -EINVAL;
     sensors_poll_context_t *dev = new sensors_poll_context_t();
 
-    memset(&dev->device, 0, sizeof(sensors_poll_device_t));
+    memset(&dev->device, 0, sizeof(sensors_poll_device_1));
 
     dev->device.common.tag = HARDWARE_DEVICE_TAG;
-    // TODO: We can't expect this version to be supported forever...
-    dev->device.common.version  = SENSORS_DEVICE_API_VERSION_0_1;
+    dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1_3;
     dev->device.common.module   = const_cast<hw_module_t*>(module);
     dev->device.common.close    = poll__close;
     dev->device.activate        = poll__activate;
     dev->device.setDelay        = poll__setDelay;
     dev->device.poll            = poll__poll;
+    dev->device.batch           = poll__batch;
+    dev->device.flush           = poll__flush;
 
     *device = &dev->device.common;
     status = 0;
@@ -41,6 +41,9 @@ __BEGIN_DECLS
 #define ID_RV (ID_O + 1)
 #define ID_LA (ID_RV + 1)
 #define ID_GR (ID_LA + 1)
+#define ID_GYU (ID_GR + 1)
+#define ID_MU (ID_GYU + 1)
+#define ID_GRV (ID_MU + 1)
 
 #define ID_SAMSUNG_BASE (0x1000)
 #define ID_L  (ID_SAMSUNG_BASE)